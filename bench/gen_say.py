@@ -0,0 +1,130 @@
+#!/usr/bin/env python3
+#  Saytring Compiler. A compiler translating Saytring to Python.
+#  Copyright (C) 2024 Haoyuan Li
+#
+#  This program is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 3 of the License, or
+#  (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+"""Generate a synthetic, well-formed Saytring program for benchmarking.
+
+    gen_say.py -n 100000 --mix decl=2,prop=1,chain=3,cond=1,arith=2 -o big.say
+
+Every statement only uses variables and properties declared before it, so
+the program goes through every phase of the compiler.
+"""
+
+import argparse
+import random
+import sys
+
+KINDS = ("decl", "prop", "chain", "cond", "arith")
+DEFAULT_MIX = "decl=2,prop=1,chain=3,cond=1,arith=2"
+
+# Built-ins taking a string and returning a string, safe to chain
+STR_FUNCS = ("reverse", "to_upper", "to_lower", "trim")
+
+
+def parse_mix(text):
+    mix = {}
+    for item in text.split(","):
+        kind, _, weight = item.partition("=")
+        if kind not in KINDS:
+            raise SystemExit("unknown statement kind: " + kind)
+        mix[kind] = float(weight)
+    return mix
+
+
+class Generator:
+    def __init__(self, rng):
+        self.rng = rng
+        self.str_vars = []  # [name, [properties]]
+        self.int_vars = []
+        self.counter = 0
+
+    def fresh(self, prefix):
+        self.counter += 1
+        return "%s%d" % (prefix, self.counter)
+
+    def decl(self):
+        if self.rng.random() < 0.5 or not self.str_vars:
+            name = self.fresh("s")
+            self.str_vars.append([name, []])
+            return 'define %s as ("text %d")' % (name, self.counter)
+        name = self.fresh("n")
+        self.int_vars.append(name)
+        return "define %s as (%d)" % (name, self.rng.randint(0, 999))
+
+    def prop(self):
+        var = self.rng.choice(self.str_vars)
+        props = [self.fresh("p") for _ in range(self.rng.randint(1, 3))]
+        var[1].extend(props)
+        return "%s has [%s]" % (var[0], ", ".join(props))
+
+    def chain(self):
+        var = self.rng.choice(self.str_vars)
+        calls = ["do " + self.rng.choice(STR_FUNCS)
+                 for _ in range(self.rng.randint(1, 4))]
+        stmt = "%s %s" % (var[0], " -> ".join(calls))
+        if var[1]:
+            stmt += " on " + self.rng.choice(var[1])
+        return stmt
+
+    def cond(self):
+        var = self.rng.choice(self.str_vars)[0]
+        if self.int_vars and self.rng.random() < 0.5:
+            test = "%s gt %d;" % (self.rng.choice(self.int_vars),
+                                  self.rng.randint(0, 999))
+        else:
+            test = "%s do is_palindrome" % var
+        return 'if %s then\n  say(%s)\nelse\n  say("no")\nendif' % (test, var)
+
+    def arith(self):
+        if len(self.int_vars) >= 2 and self.rng.random() < 0.5:
+            a, b, c = (self.rng.choice(self.int_vars) for _ in range(3))
+            return "set %s as (%s + %s;)" % (a, b, c)
+        var = self.rng.choice(self.str_vars)[0]
+        return 'set %s as (%s + "x";)' % (var, var)
+
+    def statement(self, kind):
+        # Properties, chains, conditionals and arithmetic need a string
+        # variable to work on
+        if not self.str_vars:
+            kind = "decl"
+        return getattr(self, kind)()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("-n", "--statements", type=int, default=1000)
+    parser.add_argument("--mix", default=DEFAULT_MIX,
+                        help="relative weights of the statement kinds "
+                             "(default: %s)" % DEFAULT_MIX)
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("-o", "--output", help="default: stdout")
+    args = parser.parse_args()
+
+    mix = parse_mix(args.mix)
+    kinds = list(mix)
+    weights = [mix[k] for k in kinds]
+    rng = random.Random(args.seed)
+    gen = Generator(rng)
+
+    out = open(args.output, "w") if args.output else sys.stdout
+    for _ in range(args.statements):
+        out.write(gen.statement(rng.choices(kinds, weights)[0]))
+        out.write("\n")
+    if out is not sys.stdout:
+        out.close()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+#  Saytring Compiler. A compiler translating Saytring to Python.
+#  Copyright (C) 2024 Haoyuan Li
+#
+#  This program is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 3 of the License, or
+#  (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+"""Benchmark saytringc on generated programs and append the results to a CSV.
+
+    run_bench.py --compiler ../src/saytringc --sizes 1000,10000 --csv out.csv
+
+For every size, a program is generated with gen_say.py (and kept in the
+work directory for later runs), compiled --repeat times with
+--time-report, and the fastest run is recorded: one CSV row per phase
+with its time, statements per second and the peak RSS at its end.
+"""
+
+import argparse
+import csv
+import datetime
+import json
+import os
+import subprocess
+import sys
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+FIELDS = ("date", "commit", "statements", "mix", "phase", "seconds",
+          "statements_per_second", "peak_rss_bytes")
+
+
+def git_commit():
+    try:
+        return subprocess.run(["git", "rev-parse", "--short", "HEAD"],
+                              cwd=HERE, capture_output=True, text=True,
+                              check=True).stdout.strip()
+    except (OSError, subprocess.CalledProcessError):
+        return "unknown"
+
+
+def generate(size, mix, seed, workdir):
+    path = os.path.join(workdir, "bench_%d_%d.say" % (size, seed))
+    if not os.path.exists(path):
+        subprocess.run([sys.executable, os.path.join(HERE, "gen_say.py"),
+                        "-n", str(size), "--mix", mix, "--seed", str(seed),
+                        "-o", path], check=True)
+    return path
+
+
+def compile_once(args, source, output):
+    proc = subprocess.run([args.compiler, "-i", source, "-o", output,
+                           "-t", args.runtime, "--time-report",
+                           "--report-format", "json"],
+                          capture_output=True, text=True)
+    for line in proc.stdout.splitlines():
+        if line.startswith('{"time_report"'):
+            return json.loads(line)["time_report"]
+    sys.exit("%s failed on %s:\n%s%s" % (args.compiler, source, proc.stdout,
+                                         proc.stderr))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--compiler", default=os.path.join(HERE, "..", "src",
+                                                           "saytringc"))
+    parser.add_argument("--runtime", default=os.path.join(HERE, "..",
+                                                          "runtime",
+                                                          "runtime.py"))
+    parser.add_argument("--sizes", default="1000,10000,100000,1000000",
+                        help="statement counts, comma separated")
+    parser.add_argument("--mix", default="decl=2,prop=1,chain=3,cond=1,"
+                                         "arith=2")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--repeat", type=int, default=3)
+    parser.add_argument("--workdir", default=os.path.join(HERE, "work"))
+    parser.add_argument("--csv", default=os.path.join(HERE, "results.csv"))
+    args = parser.parse_args()
+
+    os.makedirs(args.workdir, exist_ok=True)
+    new_file = not os.path.exists(args.csv)
+    date = datetime.datetime.now().isoformat(timespec="seconds")
+    commit = git_commit()
+
+    with open(args.csv, "a", newline="") as out:
+        writer = csv.writer(out)
+        if new_file:
+            writer.writerow(FIELDS)
+        for size in (int(s) for s in args.sizes.split(",")):
+            source = generate(size, args.mix, args.seed, args.workdir)
+            output = os.path.join(args.workdir, "bench_%d.py" % size)
+            runs = [compile_once(args, source, output)
+                    for _ in range(args.repeat)]
+            best = min(runs, key=lambda run: run["total_seconds"])
+
+            for phase in best["phases"] + [{"phase": "total",
+                                            "seconds": best["total_seconds"],
+                                            "peak_rss": max(
+                                                p["peak_rss"]
+                                                for p in best["phases"])}]:
+                seconds = phase["seconds"]
+                writer.writerow((date, commit, size, args.mix, phase["phase"],
+                                 "%.9f" % seconds,
+                                 "%.0f" % (size / seconds) if seconds else "",
+                                 phase["peak_rss"]))
+            print("%9d statements: %8.3f s, %10.0f statements/s, "
+                  "%6d KiB peak RSS" % (size, best["total_seconds"],
+                                        size / best["total_seconds"],
+                                        max(p["peak_rss"]
+                                            for p in best["phases"]) // 1024))
+    print("Results appended to " + args.csv)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,964 @@
+/*
+  Saytring Runtime. The runtime environment of Saytring programs compiled
+  to C++ with --target cpp.
+  Copyright (C) 2024 Haoyuan Li
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// A port of runtime.py, function by function, so that a program behaves
+// the same compiled to either language: the same output, the same warnings
+// and the same skipped steps. Python's own errors, which end a Python
+// program with a traceback, end the program with their last line on
+// stderr and exit status 1.
+//
+// Strings are UTF-8 and counted, indexed and reversed by code point, as in
+// Python. Differences left: ints are 64 bits (overflow is an error),
+// to_lower and to_upper only change ASCII letters, and \N{name} escapes in
+// string constants are not decoded. The VM of --run leaves programs calling
+// to_lower or to_upper, or with int constants beyond 64 bits, to python.
+// A variable initializing another, which Python keeps as the value of the
+// new one, is refused for --target cpp by the semantic check.
+//
+// Unlike runtime.py, no variable is defined here: the generated program
+// defines every one it uses, _anonymous and _anonymous_last_result too.
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#define WARN_MSG_STRLEN 10
+#define STEP_SKIP_MSG "Saytring: Step skipped due to type casting error"
+
+enum class DataType { INT = 1, STRING = 2, BOOL = 3, LIST = 4, NULL_TYPE = 5 };
+
+// The TypeError the runtime catches to skip a step
+struct Type_Error {};
+
+// Any other Python error, which ends the program
+struct Fatal_Error {
+  std::string message; // the last line of the Python traceback
+};
+
+//////////////////////////////////////////////
+////////////////// Strings ///////////////////
+//////////////////////////////////////////////
+
+static bool is_ascii(const std::string &s) {
+  for (unsigned char c : s)
+    if (c >= 0x80)
+      return false;
+  return true;
+}
+
+static bool is_continuation(unsigned char c) { return (c & 0xC0) == 0x80; }
+
+// len() of a str
+static size_t cp_length(const std::string &s) {
+  size_t n = 0;
+  for (unsigned char c : s)
+    n += !is_continuation(c);
+  return n;
+}
+
+// Byte offset of code point index in s, or s.size() past its end
+static size_t cp_offset(const std::string &s, size_t index) {
+  size_t pos = 0;
+  for (; pos < s.size(); pos++)
+    if (!is_continuation(s[pos]) && index-- == 0)
+      break;
+  return pos;
+}
+
+// s[start:end], with Python's negative and out of range indices
+static std::string cp_slice(const std::string &s, long long start,
+                            long long end) {
+  long long n = cp_length(s);
+  if (start < 0)
+    start = std::max(start + n, 0LL);
+  if (end < 0)
+    end = std::max(end + n, 0LL);
+  start = std::min(start, n);
+  end = std::min(end, n);
+  if (start >= end)
+    return "";
+  size_t from = cp_offset(s, start);
+  return s.substr(from, cp_offset(s, end) - from);
+}
+
+// s[::-1]
+static std::string cp_reverse(const std::string &s) {
+  std::string r(s.rbegin(), s.rend());
+  if (is_ascii(s))
+    return r;
+  // Put the bytes of every code point back in order
+  for (size_t end = 0; end < r.size();) {
+    size_t start = end;
+    while (end < r.size() && is_continuation(r[end]))
+      end++;
+    end = std::min(end + 1, r.size());
+    std::reverse(r.begin() + start, r.begin() + end);
+  }
+  return r;
+}
+
+// The code point starting at pos, setting next past it
+static uint32_t decode_at(const std::string &s, size_t pos, size_t &next) {
+  unsigned char c = s[pos];
+  int len = c < 0x80 ? 1 : c < 0xE0 ? 2 : c < 0xF0 ? 3 : 4;
+  uint32_t cp = len == 1 ? c : c & (0x7F >> len);
+  next = pos + 1;
+  for (int i = 1; i < len && next < s.size() && is_continuation(s[next]); i++)
+    cp = (cp << 6) | (s[next++] & 0x3F);
+  return cp;
+}
+
+// str.isspace()
+static bool is_space(uint32_t cp) {
+  return (cp >= 0x09 && cp <= 0x0D) || (cp >= 0x1C && cp <= 0x20) ||
+         cp == 0x85 || cp == 0xA0 || cp == 0x1680 ||
+         (cp >= 0x2000 && cp <= 0x200A) || cp == 0x2028 || cp == 0x2029 ||
+         cp == 0x202F || cp == 0x205F || cp == 0x3000;
+}
+
+// str.strip()
+static std::string py_strip(const std::string &s) {
+  size_t start = 0, next;
+  while (start < s.size() && is_space(decode_at(s, start, next)))
+    start = next;
+  size_t end = s.size();
+  while (end > start) {
+    size_t last = end - 1;
+    while (last > start && is_continuation(s[last]))
+      last--;
+    if (!is_space(decode_at(s, last, next)))
+      break;
+    end = last;
+  }
+  return s.substr(start, end - start);
+}
+
+static std::string ascii_case(std::string s, bool upper) {
+  for (char &c : s)
+    if (upper ? (c >= 'a' && c <= 'z') : (c >= 'A' && c <= 'Z'))
+      c ^= 0x20;
+  return s;
+}
+
+// str.replace(old, new)
+static std::string py_replace(const std::string &s, const std::string &old,
+                              const std::string &with) {
+  std::string r;
+  if (old.empty()) {
+    // Between every two code points, and at both ends
+    r = with;
+    for (size_t pos = 0, next; pos < s.size(); pos = next) {
+      decode_at(s, pos, next);
+      r.append(s, pos, next - pos).append(with);
+    }
+    return r;
+  }
+  size_t pos = 0;
+  for (size_t hit; (hit = s.find(old, pos)) != std::string::npos;
+       pos = hit + old.size())
+    r.append(s, pos, hit - pos).append(with);
+  return r.append(s, pos, std::string::npos);
+}
+
+// int() of a str: ValueError, reported as false, unless it is an optionally
+// signed decimal, with single underscores between digits, in whitespace
+static bool py_parse_int(const std::string &text, long long &value) {
+  std::string s = py_strip(text);
+  size_t pos = 0;
+  bool negative = false;
+  if (pos < s.size() && (s[pos] == '+' || s[pos] == '-'))
+    negative = s[pos++] == '-';
+  if (pos == s.size())
+    return false;
+  unsigned long long magnitude = 0;
+  bool digit_before = false;
+  for (; pos < s.size(); pos++) {
+    char c = s[pos];
+    if (c == '_' && digit_before && pos + 1 < s.size() && s[pos + 1] != '_') {
+      digit_before = false;
+      continue;
+    }
+    if (c < '0' || c > '9')
+      return false;
+    if (magnitude > (ULLONG_MAX - 9) / 10)
+      throw Fatal_Error{"OverflowError: int too large for 64 bits"};
+    magnitude = magnitude * 10 + (c - '0');
+    digit_before = true;
+  }
+  if (!digit_before)
+    return false;
+  if (magnitude > (unsigned long long)LLONG_MAX + negative)
+    throw Fatal_Error{"OverflowError: int too large for 64 bits"};
+  value = negative ? (long long)(0 - magnitude) : (long long)magnitude;
+  return true;
+}
+
+//////////////////////////////////////////////
+/////////////////// Values ///////////////////
+//////////////////////////////////////////////
+
+// A Python value of the generated code: an int, a str, a bool or a list of
+// str. A bool is an int too, as in Python.
+struct Value {
+  enum Kind { INT, STR, BOOL, LIST } kind;
+  long long i;   // INT, and BOOL as 0 or 1
+  std::string s; // STR
+  std::shared_ptr<const std::vector<std::string>> list; // LIST
+
+  Value() : kind(STR), i(0) {}
+  Value(int i) : kind(INT), i(i) {}
+  Value(long long i) : kind(INT), i(i) {}
+  Value(bool b) : kind(BOOL), i(b) {}
+  Value(const char *s) : kind(STR), i(0), s(s) {}
+  Value(std::string s) : kind(STR), i(0), s(std::move(s)) {}
+  Value(std::vector<std::string> list)
+      : kind(LIST), i(0),
+        list(std::make_shared<const std::vector<std::string>>(
+            std::move(list))) {}
+
+  bool is_int() const { return kind == INT || kind == BOOL; }
+  const char *type_name() const {
+    static const char *names[] = {"int", "str", "bool", "list"};
+    return names[kind];
+  }
+};
+
+// String literals of the generated code, which may hold '\0'
+static Value operator""_s(const char *s, size_t len) {
+  return Value(std::string(s, len));
+}
+
+// An int constant of the generated code that does not fit in 64 bits
+static Value int_too_large() {
+  throw Fatal_Error{"OverflowError: int too large for 64 bits"};
+}
+
+// str() of a value
+static std::string py_str(const Value &v) {
+  switch (v.kind) {
+  case Value::INT:
+    return std::to_string(v.i);
+  case Value::BOOL:
+    return v.i ? "True" : "False";
+  case Value::LIST: {
+    std::string r = "[";
+    for (size_t i = 0; i < v.list->size(); i++)
+      r.append(i ? ", '" : "'").append((*v.list)[i]).append("'");
+    return r + "]";
+  }
+  default:
+    return v.s;
+  }
+}
+
+static bool py_truth(const Value &v) {
+  if (v.kind == Value::STR)
+    return !v.s.empty();
+  if (v.kind == Value::LIST)
+    return !v.list->empty();
+  return v.i != 0;
+}
+
+// When set, what the thread prints goes there instead of stdout, as for
+// the records run by the threads of saytringc's VM
+static thread_local std::string *print_buffer = nullptr;
+
+static void print(const std::string &s) {
+  if (print_buffer) {
+    print_buffer->append(s).push_back('\n');
+    return;
+  }
+  fwrite(s.data(), 1, s.size(), stdout);
+  putc('\n', stdout);
+}
+
+static void print(const char *s) { print(std::string(s)); }
+
+static void print(const Value &v) { print(py_str(v)); }
+
+// input(): a line of stdin, without its line break. Python reads stdin in
+// universal newlines mode, so "\r\n" and "\r" end lines too.
+static std::string input(const std::string &prompt = "") {
+  fwrite(prompt.data(), 1, prompt.size(), stdout);
+  fflush(stdout);
+  std::string line;
+  int c;
+  while ((c = getchar()) != EOF) {
+    if (c == '\n')
+      return line;
+    if (c == '\r') {
+      if ((c = getchar()) != '\n' && c != EOF)
+        ungetc(c, stdin);
+      return line;
+    }
+    line.push_back((char)c);
+  }
+  if (line.empty())
+    throw Fatal_Error{"EOFError: EOF when reading a line"};
+  return line;
+}
+
+//////////////////////////////////////////////
+///////////////// SaytringVar ////////////////
+//////////////////////////////////////////////
+
+class SaytringVar {
+public:
+  Value value;
+  DataType type;
+
+private:
+  // The string form of the value, made when it is asked for
+  mutable std::string str_cache;
+  mutable bool has_str;
+
+  std::string to_string() const {
+    switch (type) {
+    case DataType::INT:
+    case DataType::STRING:
+      return py_str(value);
+    case DataType::BOOL:
+      return py_truth(value) ? "True" : "False";
+    case DataType::LIST: {
+      if (value.kind != Value::LIST)
+        return py_str(value);
+      std::string r = "[";
+      for (size_t i = 0; i < value.list->size(); i++)
+        r.append(i ? ", " : "").append((*value.list)[i]);
+      return r + "]";
+    }
+    default:
+      return "None";
+    }
+  }
+
+public:
+  // Default value leads to an instance with NULL_Type and ""
+  SaytringVar() : type(DataType::NULL_TYPE), has_str(false) {}
+  SaytringVar(Value value, DataType type)
+      : value(std::move(value)), type(type), has_str(false) {}
+
+  const std::string &get_str_value() const {
+    if (type == DataType::STRING && value.kind == Value::STR)
+      return value.s;
+    if (!has_str) {
+      str_cache = to_string();
+      has_str = true;
+    }
+    return str_cache;
+  }
+
+  DataType get_type() const { return type; }
+  const Value &get_value() const { return value; }
+
+  void set_value(Value v) {
+    switch (v.kind) {
+    case Value::BOOL:
+      type = DataType::BOOL;
+      break;
+    case Value::INT:
+      type = DataType::INT;
+      break;
+    case Value::STR:
+      type = DataType::STRING;
+      break;
+    case Value::LIST:
+      type = DataType::LIST;
+      break;
+    }
+    value = std::move(v);
+    has_str = false;
+  }
+
+  void set_value(const SaytringVar &s) {
+    if (s.type == DataType::NULL_TYPE)
+      print("Saytring: Try to get value of a NULL_Type variable. This may "
+            "cause unsafe behaviour");
+    set_value(Value(s.value));
+  }
+
+  void set_NULL_value(Value v) {
+    type = DataType::NULL_TYPE;
+    value = std::move(v);
+    has_str = false;
+  }
+
+  const std::string &cast_str() const {
+    if (type == DataType::NULL_TYPE) {
+      print_warn_msg("Saytring: Try to cast a NULL_Type variable to string");
+      throw Type_Error();
+    }
+    return get_str_value();
+  }
+
+  const Value &cast_int() const {
+    if (type != DataType::INT) {
+      print_warn_msg("Saytring: Try to cast a non-int variable to int");
+      throw Type_Error();
+    }
+    return value;
+  }
+
+  const Value &cast_list() const {
+    if (type != DataType::LIST) {
+      print_warn_msg("Saytring: Try to cast a non-list variable to list");
+      throw Type_Error();
+    }
+    return value;
+  }
+
+  const Value &cast_bool() const {
+    if (type != DataType::BOOL) {
+      print_warn_msg("Saytring: Try to cast a non-bool variable to bool");
+      throw Type_Error();
+    }
+    return value;
+  }
+
+  void print_warn_msg(const char *msg) const {
+    print(msg);
+    const std::string &s = get_str_value();
+    std::string shown = cp_slice(s, 0, WARN_MSG_STRLEN);
+    if (cp_length(s) > WARN_MSG_STRLEN)
+      print("Saytring: Affected var: \"" + shown + "...\"");
+    else
+      print("Saytring: Affected var: \"" + shown + "\"");
+  }
+};
+
+// An argument of a built-in: a variable, or a value computed by the
+// generated code, as the Python functions take either
+struct Arg {
+  const SaytringVar *var;
+  Value value;
+  Arg(const SaytringVar &var) : var(&var) {}
+  Arg(Value value) : var(nullptr), value(std::move(value)) {}
+  Arg(const char *s) : var(nullptr), value(s) {}
+};
+
+// `s if isinstance(s, str) else s.cast_str()`
+static const std::string &str_or_cast(const Arg &a) {
+  if (a.var)
+    return a.var->cast_str();
+  if (a.value.kind != Value::STR)
+    throw Fatal_Error{std::string("AttributeError: '") +
+                      a.value.type_name() +
+                      "' object has no attribute 'cast_str'"};
+  return a.value.s;
+}
+
+// `s.cast_str() if isinstance(s, SaytringVar) else s`
+static Value cast_or_value(const Arg &a) {
+  return a.var ? Value(a.var->cast_str()) : a.value;
+}
+
+// `s.cast_int() if isinstance(s, SaytringVar) else s`
+static Value int_or_value(const Arg &a) {
+  return a.var ? a.var->cast_int() : a.value;
+}
+
+// A str where Python would raise a TypeError on anything else
+static const std::string &need_str(const Value &v) {
+  if (v.kind != Value::STR)
+    throw Type_Error();
+  return v.s;
+}
+
+static long long need_int(const Value &v) {
+  if (!v.is_int())
+    throw Type_Error();
+  return v.i;
+}
+
+//////////////////////////////////////////////
+/////////////// Type-cast Functions //////////
+//////////////////////////////////////////////
+
+static void cast_int_to_str(SaytringVar &s, SaytringVar &t) {
+  s.set_value(Value(s.get_str_value()));
+  t.set_value(true);
+}
+
+static void cast_bool_to_str(SaytringVar &s, SaytringVar &t) {
+  s.set_value(Value(s.get_str_value()));
+  t.set_value(true);
+}
+
+static void cast_list_to_str(SaytringVar &s, SaytringVar &t) {
+  s.set_value(Value(s.get_str_value()));
+  t.set_value(true);
+}
+
+static void cast_null_to_str(SaytringVar &s, SaytringVar &t) {
+  if (s.get_type() != DataType::NULL_TYPE) {
+    s.print_warn_msg("Saytring: Try to perform NULL_Type type cast on a "
+                     "non-NULL_Type variable");
+    t.set_value(false);
+  }
+  std::string result = py_str(s.get_value());
+  if (s.get_value().kind == Value::LIST) {
+    // "[" + ", ".join(map(str, value)) + "]"
+    result = "[";
+    const auto &list = *s.get_value().list;
+    for (size_t i = 0; i < list.size(); i++)
+      result.append(i ? ", " : "").append(list[i]);
+    result += "]";
+  }
+  t.set_value(true);
+  s.set_value(Value(result));
+}
+
+static void cast_null_to_int(SaytringVar &s, SaytringVar &t) {
+  if (s.get_type() != DataType::NULL_TYPE) {
+    s.print_warn_msg("Saytring: Try to perform NULL_Type type cast on a "
+                     "non-NULL_Type variable");
+    t.set_value(false);
+  }
+  const Value &value = s.get_value();
+  long long result;
+  if (value.is_int()) {
+    s.set_value(Value(value.i));
+    t.set_value(true);
+  } else if (value.kind == Value::STR && py_parse_int(value.s, result)) {
+    s.set_value(Value(result));
+    t.set_value(true);
+  } else {
+    t.set_value(false);
+  }
+}
+
+static bool is_true_text(const Value &v) {
+  if (v.kind != Value::STR)
+    return false;
+  for (const char *text : {"True", "true", "1", "t", "T", "y", "Y"})
+    if (v.s == text)
+      return true;
+  return false;
+}
+
+static bool is_false_text(const Value &v) {
+  if (v.kind != Value::STR)
+    return false;
+  for (const char *text : {"Flase", "flase", "0", "f", "F", "n", "N"})
+    if (v.s == text)
+      return true;
+  return false;
+}
+
+static void cast_null_to_bool(SaytringVar &s, SaytringVar &t) {
+  if (s.get_type() != DataType::NULL_TYPE) {
+    s.print_warn_msg("Saytring: Try to perform NULL_Type type cast on a "
+                     "non-NULL_Type variable");
+    t.set_value(false);
+  }
+  const Value &value = s.get_value();
+  bool result;
+  if (value.kind == Value::BOOL)
+    result = value.i != 0;
+  else if (value.kind == Value::STR)
+    result = is_true_text(value);
+  else {
+    t.set_value(false);
+    return;
+  }
+  s.set_value(result);
+  t.set_value(true);
+}
+
+static void cast_str_to_bool(SaytringVar &s, SaytringVar &t) {
+  if (s.get_type() != DataType::STRING) {
+    s.print_warn_msg(
+        "Saytring: Try to perform String type cast on a non-String variable");
+    t.set_value(false);
+  }
+  if (is_true_text(s.get_value()))
+    s.set_value(true);
+  else if (is_false_text(s.get_value()))
+    s.set_value(false);
+  else {
+    t.set_value(false);
+    return;
+  }
+  t.set_value(true);
+}
+
+static void cast_str_to_int(SaytringVar &s, SaytringVar &t) {
+  if (s.get_type() != DataType::STRING) {
+    s.print_warn_msg(
+        "Saytring: Try to perform String type cast on a non-String variable");
+    t.set_value(false);
+  }
+  const Value &value = s.get_value();
+  long long result;
+  if (value.is_int()) {
+    s.set_value(Value(value.i));
+    t.set_value(true);
+  } else if (value.kind == Value::LIST) {
+    throw Fatal_Error{"TypeError: int() argument must be a string, a "
+                      "bytes-like object or a real number, not 'list'"};
+  } else if (py_parse_int(value.s, result)) {
+    s.set_value(Value(result));
+    t.set_value(true);
+  } else {
+    t.set_value(false);
+  }
+}
+
+static void cast_int_to_bool(SaytringVar &s, SaytringVar &t) {
+  if (s.get_type() != DataType::INT) {
+    s.print_warn_msg(
+        "Saytring: Try to perform Int type cast on a non-Int variable");
+    t.set_value(false);
+    return;
+  }
+  s.set_value(s.get_value().i > 0);
+  t.set_value(true);
+}
+
+static void cast_bool_to_int(SaytringVar &s, SaytringVar &t) {
+  if (s.get_type() != DataType::BOOL) {
+    s.print_warn_msg(
+        "Saytring: Try to perform Bool type cast on a non-Bool variable");
+    t.set_value(false);
+  }
+  t.set_value(Value(py_truth(s.get_value()) ? 1 : 0));
+  t.set_value(true);
+}
+
+static bool bool_wrap(const Arg &s) {
+  if (s.var) {
+    try {
+      return s.var->cast_bool().i != 0;
+    } catch (Type_Error &) {
+      print("Saytring: Due to type error, _bool_wrap return False by default");
+      return false;
+    }
+  }
+  if (s.value.kind == Value::BOOL)
+    return s.value.i != 0;
+  print("Saytring: Unsupported type in _bool_warp, return False by default");
+  return false;
+}
+
+//////////////////////////////////////////////
+////////////// Operation Functions ///////////
+//////////////////////////////////////////////
+
+enum class Op { ADD, SUB, EQ, NE, LT, LE, GT, GE };
+
+// The value of an operand, or false if it is a variable of another type
+static bool operand_value(const Arg &s, Value &value, const char *msg) {
+  if (!s.var) {
+    value = s.value;
+    return true;
+  }
+  if (s.var->get_type() == DataType::STRING) {
+    value = Value(s.var->cast_str());
+    return true;
+  }
+  if (s.var->get_type() == DataType::INT) {
+    value = s.var->cast_int();
+    return true;
+  }
+  print(msg);
+  return false;
+}
+
+static Value comp(const Arg &s1, const Arg &s2, Op op) {
+  const char *msg = "Saytring: Try to perform comparison operation on a "
+                    "non-String/Int variable, return False by default.";
+  Value t1, t2;
+  bool known1 = operand_value(s1, t1, msg);
+  bool known2 = operand_value(s2, t2, msg);
+  if (!known1 || !known2)
+    return false;
+  if (t1.kind != t2.kind) {
+    print("Saytring: Try to compare two varibale with different type, return "
+          "False by default");
+    return false;
+  }
+  int order = t1.kind == Value::STR
+                  ? t1.s.compare(t2.s)
+                  : (t1.i < t2.i ? -1 : t1.i > t2.i ? 1 : 0);
+  switch (op) {
+  case Op::EQ:
+    return order == 0;
+  case Op::NE:
+    return order != 0;
+  case Op::LT:
+    return order < 0;
+  case Op::LE:
+    return order <= 0;
+  case Op::GT:
+    return order > 0;
+  case Op::GE:
+    return order >= 0;
+  default:
+    throw Fatal_Error{"KeyError: 'ADD'"};
+  }
+}
+
+// _remove_tail() on two str
+static std::string remove_tail_of(const std::string &s,
+                                  const std::string &tail) {
+  if (s.size() < tail.size() ||
+      s.compare(s.size() - tail.size(), tail.size(), tail) != 0)
+    return s;
+  return tail.empty() ? "" : s.substr(0, s.size() - tail.size());
+}
+
+static Value arithmetic(const Arg &s1, const Arg &s2, Op op) {
+  const char *msg = "Saytring: Try to perform arithmetic operation on a "
+                    "non-String/Int variable, return 0 by default.";
+  Value t1, t2;
+  bool known1 = operand_value(s1, t1, msg);
+  bool known2 = operand_value(s2, t2, msg);
+  if (!known1 || !known2)
+    return 0;
+  if (t1.kind == Value::STR && t2.kind == Value::STR) {
+    if (op == Op::ADD)
+      return t1.s + t2.s;
+    if (op == Op::SUB)
+      return remove_tail_of(t1.s, t2.s);
+  }
+  if (t1.is_int() && t2.is_int()) {
+    long long r;
+    if ((op == Op::SUB && __builtin_sub_overflow(t1.i, t2.i, &r)) ||
+        (op == Op::ADD && __builtin_add_overflow(t1.i, t2.i, &r)))
+      throw Fatal_Error{"OverflowError: int too large for 64 bits"};
+    if (op == Op::SUB || op == Op::ADD)
+      return r;
+  }
+  print("Saytring: Cannot perform arithmetic operation between int and "
+        "string, return 0 by default");
+  print(STEP_SKIP_MSG);
+  return 0;
+}
+
+//////////////////////////////////////////////
+/////////////// Normal Functions /////////////
+//////////////////////////////////////////////
+
+static void reverse(SaytringVar &s, SaytringVar &t) {
+  try {
+    t.set_value(Value(cp_reverse(s.cast_str())));
+  } catch (Type_Error &) {
+    print(STEP_SKIP_MSG);
+  }
+}
+
+static void concat(SaytringVar &s1, const Arg &s2, SaytringVar &t) {
+  try {
+    std::string r = s1.cast_str();
+    t.set_value(Value(r.append(str_or_cast(s2))));
+  } catch (Type_Error &) {
+    print(STEP_SKIP_MSG);
+  }
+}
+
+static void substring(SaytringVar &s, const Arg &start, const Arg &end,
+                      SaytringVar &t) {
+  try {
+    Value from = int_or_value(start);
+    Value to = int_or_value(end);
+    const std::string &str = s.cast_str();
+    t.set_value(Value(cp_slice(str, need_int(from), need_int(to))));
+  } catch (Type_Error &) {
+    print(STEP_SKIP_MSG);
+  }
+}
+
+static void substring_from_start(SaytringVar &s, const Arg &end,
+                                 SaytringVar &t) {
+  try {
+    Value to = int_or_value(end);
+    const std::string &str = s.cast_str();
+    t.set_value(Value(cp_slice(str, 0, need_int(to))));
+  } catch (Type_Error &) {
+    print(STEP_SKIP_MSG);
+  }
+}
+
+static void get_length(SaytringVar &s, SaytringVar &t) {
+  try {
+    t.set_value(Value((long long)cp_length(s.cast_str())));
+  } catch (Type_Error &) {
+    print(STEP_SKIP_MSG);
+  }
+}
+
+static void is_palindrome(SaytringVar &s, SaytringVar &t) {
+  try {
+    const std::string &str = s.cast_str();
+    t.set_value(str == cp_reverse(str));
+  } catch (Type_Error &) {
+    print(STEP_SKIP_MSG);
+  }
+}
+
+static void say(const Arg &s) {
+  try {
+    if (s.var)
+      print(s.var->cast_str());
+    else
+      print(s.value);
+  } catch (Type_Error &) {
+    print(STEP_SKIP_MSG);
+  }
+}
+
+static void ask(SaytringVar &t) { t.set_NULL_value(Value(input())); }
+
+static void ask_with_prompt(const Arg &s, SaytringVar &t) {
+  try {
+    std::string prompt = s.var ? s.var->cast_str() : py_str(s.value);
+    t.set_NULL_value(Value(input(prompt)));
+  } catch (Type_Error &) {
+    print(STEP_SKIP_MSG);
+  }
+}
+
+static void replace(SaytringVar &s, const Arg &old, const Arg &with,
+                    SaytringVar &t) {
+  try {
+    const std::string &s_str = s.cast_str();
+    Value old_str = cast_or_value(old);
+    Value new_str = cast_or_value(with);
+    t.set_value(Value(py_replace(s_str, need_str(old_str), need_str(new_str))));
+  } catch (Type_Error &) {
+    print(STEP_SKIP_MSG);
+    t.set_NULL_value(Value(""));
+  }
+}
+
+static void find(SaytringVar &s, const Arg &sub, SaytringVar &t) {
+  try {
+    const std::string &target = s.cast_str();
+    Value sub_str = cast_or_value(sub);
+    size_t hit = target.find(need_str(sub_str));
+    long long index = hit == std::string::npos
+                          ? -1
+                          : (long long)cp_length(target.substr(0, hit));
+    t.set_value(Value(index));
+  } catch (Type_Error &) {
+    print(STEP_SKIP_MSG);
+    t.set_NULL_value(Value(-1));
+  }
+}
+
+static void to_lower(SaytringVar &s, SaytringVar &t) {
+  try {
+    t.set_value(Value(ascii_case(s.cast_str(), false)));
+  } catch (Type_Error &) {
+    print(STEP_SKIP_MSG);
+    t.set_NULL_value(Value(""));
+  }
+}
+
+static void to_upper(SaytringVar &s, SaytringVar &t) {
+  try {
+    t.set_value(Value(ascii_case(s.cast_str(), true)));
+  } catch (Type_Error &) {
+    print(STEP_SKIP_MSG);
+    t.set_NULL_value(Value(""));
+  }
+}
+
+static void trim(SaytringVar &s, SaytringVar &t) {
+  try {
+    t.set_value(Value(py_strip(s.cast_str())));
+  } catch (Type_Error &) {
+    print(STEP_SKIP_MSG);
+    t.set_NULL_value(Value(""));
+  }
+}
+
+static void split(SaytringVar &s, const Arg &delimiter, SaytringVar &t) {
+  try {
+    const std::string &source = s.cast_str();
+    Value delim_value = cast_or_value(delimiter);
+    const std::string &delim = need_str(delim_value);
+    if (delim.empty())
+      throw Fatal_Error{"ValueError: empty separator"};
+    std::vector<std::string> result;
+    size_t pos = 0;
+    for (size_t hit; (hit = source.find(delim, pos)) != std::string::npos;
+         pos = hit + delim.size())
+      result.push_back(source.substr(pos, hit - pos));
+    result.push_back(source.substr(pos));
+    t.set_value(Value(std::move(result)));
+  } catch (Type_Error &) {
+    print(STEP_SKIP_MSG);
+    t.set_NULL_value(Value(""));
+  }
+}
+
+static void get_at(SaytringVar &s, const Arg &index, SaytringVar &t) {
+  try {
+    Value index_value = int_or_value(index);
+    const Value &list_value = s.cast_list();
+    long long i = need_int(index_value);
+    if (i < 0 || i >= (long long)list_value.list->size()) {
+      print("Saytring: Index error in get_at: Index out of range");
+      print(STEP_SKIP_MSG);
+      t.set_NULL_value(Value(""));
+      return;
+    }
+    t.set_value(Value((*list_value.list)[i]));
+  } catch (Type_Error &) {
+    print(STEP_SKIP_MSG);
+    t.set_NULL_value(Value(""));
+  }
+}
+
+//////////////////////////////////////////////
+/////////////// Reused Results ///////////////
+//////////////////////////////////////////////
+
+// _reuse() of runtime.py: whether a pure built-in called on these
+// variables, unchanged since a call that kept its result, would succeed
+static bool reusable(std::initializer_list<const SaytringVar *> inputs) {
+  for (const SaytringVar *input : inputs)
+    if (input->get_type() == DataType::NULL_TYPE)
+      return false;
+  return true;
+}
+
+// Run the program as a Python interpreter would run the script
+static int run(void (*program)()) {
+  static char buffer[1 << 16];
+  setvbuf(stdout, buffer, _IOFBF, sizeof(buffer));
+  try {
+    program();
+  } catch (Fatal_Error &e) {
+    fflush(stdout);
+    fprintf(stderr, "Traceback (most recent call last):\n%s\n",
+            e.message.c_str());
+    return 1;
+  }
+  fflush(stdout);
+  return 0;
+}
@@ -17,6 +17,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 """
 
 from __future__ import annotations
+import operator
 from enum import Enum
 from typing import List, Union, cast
 
@@ -32,8 +33,18 @@ class DataType(Enum):
     NULL_TYPE = 5
 
 
+# Type tags checked by the type-specialized code of the compiler
+_T_INT = DataType.INT
+_T_STR = DataType.STRING
+_T_NULL = DataType.NULL_TYPE
+
+
 # Warp Class for variables in Saytring
 class SaytringVar:
+    # The string form of the value is only made when it is asked for, and
+    # kept in _str until the next write
+    __slots__ = ("_value", "_type", "_str")
+
     # Default value leads to an instance with NULL_Type and ""
     def __init__(
         self,
@@ -42,7 +53,14 @@ class SaytringVar:
     ):
         self._value = value
         self._type: DataType = tp
-        self._str_value: str = self._to_string()
+        self._str: str | None = None
+
+    @property
+    def _str_value(self) -> str:
+        s = self._str
+        if s is None:
+            s = self._str = self._to_string()
+        return s
 
     def _to_string(self) -> str:
         if self._type == DataType.INT:
@@ -80,12 +98,37 @@ class SaytringVar:
             raise TypeError(f"Unsupported value type: {type(unwrap_value)}")
 
         self._value = unwrap_value
-        self._str_value = self._to_string()
+        self._str = None
 
     def set_NULL_value(self, value: Union[int, str, bool, List[str]]):
         self._type = DataType.NULL_TYPE
         self._value = value
-        self._str_value = self._to_string()  # Update _str_value
+        self._str = None  # Update _str_value
+
+    # set_value() for a value known to be of the type, used by the
+    # type-specialized code of the compiler
+    def _set_str(self, value: str):
+        self._type = DataType.STRING
+        self._value = value
+        self._str = value
+
+    def _set_int(self, value: int):
+        self._type = DataType.INT
+        self._value = value
+        self._str = None
+
+    def _set_bool(self, value: bool):
+        self._type = DataType.BOOL
+        self._value = value
+        self._str = None
+
+    # A copy of the variable, for the compiler to keep a result in
+    def _copy(self) -> SaytringVar:
+        var = SaytringVar.__new__(SaytringVar)
+        var._value = self._value
+        var._type = self._type
+        var._str = self._str
+        return var
 
     def get_value(self) -> int | str | bool | List[str]:
         return self._value
@@ -94,9 +137,9 @@ class SaytringVar:
         return self._str_value
 
     def set_type(self, tp: DataType) -> None:
+        # _str_value stays the string form of the value as it was
+        self._str_value
         self._type = tp
-        # Update _str_value
-        self._to_string()
 
     def get_type(self) -> DataType:
         if self._type is None:
@@ -663,5 +706,160 @@ def get_at(s: SaytringVar, index: SaytringVar | int, t: SaytringVar) -> None:
         t.set_NULL_value("")
 
 
+#############################################
+######## Type-specialized Functions #########
+#############################################
+
+# Called by the compiler instead of the generic functions where the static
+# types of the operands are known. A variable can still hold anything at run
+# time, so each of them checks the run-time types first, and leaves anything
+# unexpected, warnings included, to the generic function.
+
+
+def _typed_operation(tag: DataType, tp: type, op, generic, name: str):
+    def fast(s1: SaytringVar | str | int, s2: SaytringVar | str | int):
+        v1 = s1._value if type(s1) is SaytringVar and s1._type is tag else s1
+        v2 = s2._value if type(s2) is SaytringVar and s2._type is tag else s2
+        if type(v1) is tp and type(v2) is tp:
+            return op(v1, v2)
+        return generic(s1, s2, name)
+
+    return fast
+
+
+_str_add = _typed_operation(_T_STR, str, operator.add, arithmetic, "ADD")
+_str_sub = _typed_operation(_T_STR, str, _remove_tail, arithmetic, "SUB")
+_int_add = _typed_operation(_T_INT, int, operator.add, arithmetic, "ADD")
+_int_sub = _typed_operation(_T_INT, int, operator.sub, arithmetic, "SUB")
+_str_eq = _typed_operation(_T_STR, str, operator.eq, comp, "EQ")
+_str_ne = _typed_operation(_T_STR, str, operator.ne, comp, "NE")
+_str_lt = _typed_operation(_T_STR, str, operator.lt, comp, "LT")
+_str_le = _typed_operation(_T_STR, str, operator.le, comp, "LE")
+_str_gt = _typed_operation(_T_STR, str, operator.gt, comp, "GT")
+_str_ge = _typed_operation(_T_STR, str, operator.ge, comp, "GE")
+_int_eq = _typed_operation(_T_INT, int, operator.eq, comp, "EQ")
+_int_ne = _typed_operation(_T_INT, int, operator.ne, comp, "NE")
+_int_lt = _typed_operation(_T_INT, int, operator.lt, comp, "LT")
+_int_le = _typed_operation(_T_INT, int, operator.le, comp, "LE")
+_int_gt = _typed_operation(_T_INT, int, operator.gt, comp, "GT")
+_int_ge = _typed_operation(_T_INT, int, operator.ge, comp, "GE")
+
+
+def _str_reverse(s: SaytringVar, t: SaytringVar) -> None:
+    if s._type is _T_STR and type(s._value) is str:
+        t._set_str(s._value[::-1])
+    else:
+        reverse(s, t)
+
+
+def _str_concat(s1: SaytringVar, s2: SaytringVar | str, t: SaytringVar) -> None:
+    v2 = s2._value if type(s2) is SaytringVar and s2._type is _T_STR else s2
+    if s1._type is _T_STR and type(s1._value) is str and type(v2) is str:
+        t._set_str(s1._value + v2)
+    else:
+        concat(s1, s2, t)
+
+
+def _str_get_length(s: SaytringVar, t: SaytringVar) -> None:
+    if s._type is _T_STR and type(s._value) is str:
+        t._set_int(len(s._value))
+    else:
+        get_length(s, t)
+
+
+def _str_is_palindrome(s: SaytringVar, t: SaytringVar) -> None:
+    if s._type is _T_STR and type(s._value) is str:
+        t._set_bool(s._value == s._value[::-1])
+    else:
+        is_palindrome(s, t)
+
+
+def _str_to_lower(s: SaytringVar, t: SaytringVar) -> None:
+    if s._type is _T_STR and type(s._value) is str:
+        t._set_str(s._value.lower())
+    else:
+        to_lower(s, t)
+
+
+def _str_to_upper(s: SaytringVar, t: SaytringVar) -> None:
+    if s._type is _T_STR and type(s._value) is str:
+        t._set_str(s._value.upper())
+    else:
+        to_upper(s, t)
+
+
+def _str_trim(s: SaytringVar, t: SaytringVar) -> None:
+    if s._type is _T_STR and type(s._value) is str:
+        t._set_str(s._value.strip())
+    else:
+        trim(s, t)
+
+
+# What each built-in a chain can call does to a str. Only get_length and
+# is_palindrome give something else, the compiler puts them last.
+_str_steps: dict = {
+    reverse: lambda v: v[::-1],
+    concat: operator.add,
+    get_length: len,
+    is_palindrome: lambda v: v == v[::-1],
+    to_lower: str.lower,
+    to_upper: str.upper,
+    trim: str.strip,
+}
+
+
+def _str_chain(s: SaytringVar | str, t: SaytringVar, *steps) -> None:
+    """
+    Call the built-ins of steps one after another, the first on 's' and the
+    rest on 't', storing only the last result in 't'. A step is a built-in,
+    or a tuple of concat and its argument.
+    """
+    v = s if type(s) is str else s._value
+    if type(s) is str or s._type is _T_STR and type(v) is str:
+        for step in steps:
+            if type(step) is tuple:
+                a = step[1]
+                if type(a) is SaytringVar and a._type is _T_STR:
+                    a = a._value
+                if type(a) is not str:
+                    break
+                v = v + a
+            else:
+                v = _str_steps[step](v)
+        else:
+            if type(v) is str:
+                t._set_str(v)
+            else:
+                t.set_value(v)
+            return
+    # Nothing has been stored yet, so the calls can still be made one by one
+    if type(s) is str:
+        s = SaytringVar(s, _T_STR)
+    for step in steps:
+        if type(step) is tuple:
+            step[0](s, step[1], t)
+        else:
+            step(s, t)
+        s = t
+
+
+def _reuse(saved: SaytringVar, f, *args) -> None:
+    """
+    Make the call f(*args) of a built-in the compiler knows to be pure, which
+    an earlier call on the same, unchanged inputs made with its result kept
+    in 'saved'. That call only failed if one of the inputs is NULL_TYPE: then
+    it is made again, for its warnings. Otherwise its result is stored.
+    """
+    t = args[-1]
+    for a in args[:-1]:
+        if type(a) is SaytringVar and a._type is _T_NULL:
+            f(*args)
+            return
+    if saved is not t:
+        t._value = saved._value
+        t._type = saved._type
+        t._str = saved._str
+
+
 #####################################################################################
 #####################################################################################
@@ -0,0 +1,67 @@
+/*
+  Saytring Compiler. A compiler translating Saytring to Python.
+  Copyright (C) 2024 Haoyuan Li
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "arena.h"
+#include <cstdlib>
+#include <cstring>
+
+Arena::Arena(size_t chunk_size) {
+  this->head = nullptr;
+  this->cur = this->end = nullptr;
+  this->chunk_size = chunk_size;
+  this->used_bytes = 0;
+  this->reserved_bytes = 0;
+}
+
+void *Arena::allocate_slow(size_t size, size_t align) {
+  // Oversized requests get a chunk of their own
+  size_t usable = size + align > chunk_size / 4 ? size + align : chunk_size;
+  Chunk *chunk = (Chunk *)malloc(sizeof(Chunk) + usable);
+  if (chunk == nullptr)
+    throw std::bad_alloc();
+  chunk->size = usable;
+  chunk->next = head;
+  head = chunk;
+  reserved_bytes += usable;
+
+  char *begin = (char *)(chunk + 1);
+  char *p = (char *)(((size_t)begin + align - 1) & ~(align - 1));
+  if (usable == chunk_size) { // Continue bumping in the new chunk
+    cur = p + size;
+    end = begin + usable;
+  }
+  used_bytes += size;
+  return p;
+}
+
+char *Arena::copy_string(const char *s, size_t len) {
+  char *str = (char *)allocate(len + 1, 1);
+  memcpy(str, s, len);
+  str[len] = '\0';
+  return str;
+}
+
+void Arena::release() {
+  while (head != nullptr) {
+    Chunk *next = head->next;
+    free(head);
+    head = next;
+  }
+  cur = end = nullptr;
+  used_bytes = 0;
+  reserved_bytes = 0;
+}
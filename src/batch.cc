@@ -0,0 +1,205 @@
+/*
+  Saytring Compiler. A compiler translating Saytring to Python.
+  Copyright (C) 2024 Haoyuan Li
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "batch.h"
+#include "context.h"
+#include "core_func.h"
+#include "source.h"
+#include "util.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+void Batch_Compiler::add_job(const std::string &input_filename,
+                             const std::string &output_dir) {
+  fs::path output = fs::path(input_filename).replace_extension(".py");
+  if (!output_dir.empty())
+    output = fs::path(output_dir) / output.filename();
+
+  Batch_Job job;
+  job.input_filename = input_filename;
+  job.output_filename = output.string();
+  job.success = false;
+  jobs.push_back(std::move(job));
+}
+
+bool Batch_Compiler::add_inputs(const std::string &path,
+                                const std::string &output_dir) {
+  std::error_code ec;
+  if (fs::is_directory(path, ec)) {
+    std::vector<std::string> inputs;
+    for (const auto &entry : fs::directory_iterator(path, ec))
+      if (entry.is_regular_file() && entry.path().extension() == ".say")
+        inputs.push_back(entry.path().string());
+    // Directory order is arbitrary, keep the output deterministic
+    std::sort(inputs.begin(), inputs.end());
+    for (const std::string &input : inputs)
+      add_job(input, output_dir);
+  } else {
+    std::ifstream list(path);
+    if (!list.is_open()) {
+      std::cerr << "Error: Unable to open batch input: " << path << std::endl;
+      return false;
+    }
+    std::string line;
+    while (std::getline(list, line))
+      if (!line.empty())
+        add_job(line, output_dir);
+  }
+
+  // Two workers must never write the same output, as two inputs of the
+  // same name from different directories would into output_dir
+  std::unordered_map<std::string, const std::string *> outputs;
+  for (const Batch_Job &job : jobs) {
+    std::string output =
+        fs::path(job.output_filename).lexically_normal().string();
+    auto it = outputs.emplace(output, &job.input_filename).first;
+    if (it->second != &job.input_filename) {
+      std::cerr << "Error: " << *it->second << " and " << job.input_filename
+                << " would both be compiled to " << job.output_filename
+                << std::endl;
+      return false;
+    }
+  }
+
+  if (!output_dir.empty() && !fs::is_directory(output_dir, ec) &&
+      !fs::create_directories(output_dir, ec)) {
+    std::cerr << "Error: Unable to create output directory: " << output_dir
+              << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool Batch_Compiler::load_runtime(const char *runtime_filename,
+                                  Runtime_Mode mode) {
+  runtime.set_mode(mode);
+  return runtime.load(runtime_filename);
+}
+
+void Batch_Compiler::compile(Batch_Job &job) {
+  std::ostringstream log;
+
+  Source_File source;
+  if (!source.open(job.input_filename.c_str())) {
+    log << job.input_filename << ": Failed to open file\n";
+    job.log = log.str();
+    return;
+  }
+
+  std::string key;
+  if (cache) {
+    key = Compile_Cache::key(cache_salt, job.input_filename,
+                             runtime.source(), source.data(), source.length());
+    std::string cached_log;
+    if (cache->fetch(key, job.output_filename, cached_log)) {
+      job.log = cached_log + "Generated code to " + job.output_filename + "\n";
+      job.success = true;
+      return;
+    }
+  }
+
+  Compile_Context ctx(job.input_filename, &log);
+  bool checked = ctx.check(source.data(), source.length());
+  source.close();
+  if (!checked) {
+    job.log = log.str();
+    return;
+  }
+
+  int out_fd =
+      open(job.output_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (out_fd < 0) {
+    ctx.release();
+    log << "Unable to open file: " << job.output_filename << "\n";
+    job.log = log.str();
+    return;
+  }
+  bool written;
+  {
+    Code_Sink out(out_fd);
+    ctx.generate(out, runtime);
+    written = out.flush();
+  }
+  if (close(out_fd) != 0)
+    written = false;
+
+  if (written) {
+    if (cache)
+      cache->store(key, job.output_filename, log.str());
+    log << "Generated code to " << job.output_filename << "\n";
+    job.success = true;
+  } else {
+    log << "Unable to write file: " << job.output_filename << "\n";
+  }
+  job.log = log.str();
+}
+
+// Mark a job as done and print every log that is now due
+void Batch_Compiler::finish(size_t index) {
+  std::lock_guard<std::mutex> guard(print_lock);
+  finished[index] = true;
+  while (next_to_print < jobs.size() && finished[next_to_print]) {
+    std::cout << jobs[next_to_print].log << std::flush;
+    next_to_print++;
+  }
+}
+
+void Batch_Compiler::worker() {
+  for (;;) {
+    size_t index = next_job.fetch_add(1);
+    if (index >= jobs.size())
+      return;
+    compile(jobs[index]);
+    finish(index);
+  }
+}
+
+int Batch_Compiler::run(unsigned thread_count) {
+  // The shared tables must be complete before any worker starts
+  install_type_cast_map();
+  install_buildin_func();
+
+  if (thread_count == 0)
+    thread_count = std::max(1u, std::thread::hardware_concurrency());
+  thread_count = std::min<size_t>(thread_count, std::max<size_t>(1, size()));
+
+  next_job = 0;
+  next_to_print = 0;
+  finished.assign(jobs.size(), false);
+
+  std::vector<std::thread> workers;
+  for (unsigned i = 1; i < thread_count; i++)
+    workers.emplace_back(&Batch_Compiler::worker, this);
+  worker(); // the calling thread takes part as well
+  for (std::thread &t : workers)
+    t.join();
+
+  int failed = 0;
+  for (const Batch_Job &job : jobs)
+    if (!job.success)
+      failed++;
+  return failed;
+}
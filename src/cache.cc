@@ -0,0 +1,139 @@
+/*
+  Saytring Compiler. A compiler translating Saytring to Python.
+  Copyright (C) 2024 Haoyuan Li
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "cache.h"
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+// 128-bit FNV-1a
+typedef unsigned __int128 hash128;
+static const hash128 FNV128_PRIME =
+    ((hash128)0x0000000001000000ULL << 64) | 0x000000000000013BULL;
+static const hash128 FNV128_OFFSET =
+    ((hash128)0x6c62272e07bb0142ULL << 64) | 0x62b821756295c58dULL;
+
+static hash128 hash_bytes(hash128 hash, const char *data, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    hash ^= (unsigned char)data[i];
+    hash *= FNV128_PRIME;
+  }
+  return hash;
+}
+
+// Hash the size as well, so that the fields cannot run into each other
+static hash128 hash_field(hash128 hash, const char *data, size_t size) {
+  hash = hash_bytes(hash, (const char *)&size, sizeof(size));
+  return hash_bytes(hash, data, size);
+}
+
+std::string Compile_Cache::key(const std::string &salt,
+                               const std::string &input_filename,
+                               const std::string &runtime, const char *source,
+                               size_t size) {
+  hash128 hash = FNV128_OFFSET;
+  hash = hash_field(hash, salt.data(), salt.size());
+  hash = hash_field(hash, input_filename.data(), input_filename.size());
+  hash = hash_field(hash, runtime.data(), runtime.size());
+  hash = hash_field(hash, source, size);
+
+  char hex[33];
+  snprintf(hex, sizeof(hex), "%016llx%016llx",
+           (unsigned long long)(hash >> 64), (unsigned long long)hash);
+  return hex;
+}
+
+bool Compile_Cache::open() {
+  std::error_code ec;
+  if (fs::is_directory(dir, ec) || fs::create_directories(dir, ec))
+    return true;
+  std::cerr << "Error: Unable to create cache directory: " << dir
+            << std::endl;
+  return false;
+}
+
+std::string Compile_Cache::entry_path(const std::string &key,
+                                      const char *ext) const {
+  return (fs::path(dir) / (key + ext)).string();
+}
+
+bool Compile_Cache::write_atomically(const std::string &path,
+                                     const std::string &data) {
+  // Unique among the processes and threads filling the cache
+  std::ostringstream tmp;
+  tmp << path << ".tmp." << getpid() << "."
+      << std::hash<std::thread::id>()(std::this_thread::get_id());
+
+  std::ofstream out(tmp.str(), std::ios::binary);
+  out << data;
+  out.close();
+  if (!out || rename(tmp.str().c_str(), path.c_str()) != 0) {
+    remove(tmp.str().c_str());
+    return false;
+  }
+  return true;
+}
+
+bool Compile_Cache::fetch(const std::string &key,
+                          const std::string &output_filename,
+                          std::string &log) {
+  std::ifstream log_file(entry_path(key, ".log"), std::ios::binary);
+  std::error_code ec;
+  if (!log_file.is_open() ||
+      !fs::copy_file(entry_path(key, ".py"), output_filename,
+                     fs::copy_options::overwrite_existing, ec)) {
+    misses++;
+    return false;
+  }
+  std::ostringstream buf;
+  buf << log_file.rdbuf();
+  log = buf.str();
+  hits++;
+  return true;
+}
+
+void Compile_Cache::store(const std::string &key,
+                          const std::string &output_filename,
+                          const std::string &log) {
+  std::ifstream output_file(output_filename, std::ios::binary);
+  std::ostringstream output;
+  output << output_file.rdbuf();
+  // The .py file completes the entry, so it goes last
+  if (output_file.is_open() &&
+      write_atomically(entry_path(key, ".log"), log) &&
+      write_atomically(entry_path(key, ".py"), output.str()))
+    stores++;
+  else
+    failures++;
+}
+
+void Compile_Cache::report(std::ostream &out) const {
+  unsigned lookups = hits + misses;
+  out << "Cache " << dir << ": " << hits << " hits, " << misses
+      << " misses";
+  if (lookups > 0)
+    out << " (" << hits * 100 / lookups << "% hit rate)";
+  out << ", " << stores << " stored";
+  if (failures > 0)
+    out << ", " << failures << " failed to store";
+  out << std::endl;
+}
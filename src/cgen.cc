@@ -17,252 +17,490 @@
 */
 #include "cgen.h"
 #include "AST.h"
+#include "report.h"
+#include "runtime.h"
+#include "sink.h"
 #include "symtab.h"
 #include "template.h"
 #include <cstring>
-#include <fstream>
+#include <fcntl.h>
 #include <iostream>
 #include <map>
-#include <sstream>
 #include <string>
-#include <unordered_map>
+#include <unistd.h>
 
-extern char *output_filename;
-extern char *runtime_filename;
 extern Symbol *_string, *_int, *_list, *_bool, *NULL_Type, *ERR_Type,
     *LAST_RESULT;
 
 // from core_func.cc
 extern std::map<std::pair<Symbol *, Symbol *>, std::string> *type_cast_map;
 
-std::ostringstream generated_code;
-Code_Generator *cg = new Code_Generator();
-
-void Program::code_generation() {
-  // Generate code node by node
+// Generate code node by node
+void Program::code_generate(Code_Sink &out) {
+  if (setup_list) {
+    for (Expression *expr : *setup_list) {
+      expr->code_generate(out);
+      out.newline();
+    }
+    emit<record_loop_template>(out);
+    out.indent();
+  }
   for (Expression *expr : *expr_list) {
-    expr->code_generate(generated_code);
-    generated_code << "\n";
+    expr->code_generate(out);
+    out.newline();
   }
+  if (setup_list)
+    out.dedent();
+}
 
-  // Write into output_file
-  std::ofstream out_file(output_filename);
-  std::ifstream runtime_file(runtime_filename);
-
-  if (!runtime_file.is_open()) {
-    std::cerr << "Error: Missing runtime file: " << runtime_filename
-              << std::endl;
-    return;
+void Program::runtime_refs(Runtime_Refs &refs) {
+  if (setup_list) {
+    refs.add("SaytringVar");
+    refs.add("DataType");
+    for (Expression *expr : *setup_list)
+      expr->runtime_refs(refs);
   }
+  for (Expression *expr : *expr_list)
+    expr->runtime_refs(refs);
+}
 
-  // Copy runtime into output_file
-  out_file << runtime_file.rdbuf();
+void Program::code_generate(Code_Sink &out, const Runtime &runtime) {
+  Runtime_Refs refs(runtime);
+  runtime_refs(refs);
+  runtime.write(out, refs);
+  if (runtime.get_target() == TARGET_CPP)
+    cpp_generate(out, refs);
+  else
+    code_generate(out);
+}
 
-  if (!runtime_file && !out_file) {
-    std::cerr << "Error in copying Runtime file to output file!" << std::endl;
-    return;
+size_t Program::code_generation(const char *output_filename,
+                                const Runtime &runtime, Time_Report *timer) {
+  int out_fd = open(output_filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (out_fd < 0) {
+    std::cerr << "Unable to open file: " << output_filename << std::endl;
+    return 0;
   }
 
-  // Input generated code into output_file
-  if (out_file.is_open()) {
-    out_file.write(generated_code.str().c_str(), generated_code.str().size());
-    out_file.close();
-    std::cout << "Generated code to " << output_filename << std::endl;
-  } else {
-    std::cerr << "Unable to open file: " << output_filename << std::endl;
+  // The runtime, then the generated code, go through the same buffer
+  Code_Sink out(out_fd);
+  Runtime_Refs refs(runtime);
+  runtime_refs(refs);
+  runtime.write(out, refs);
+  size_t runtime_bytes = out.bytes();
+  if (timer)
+    timer->lap("runtime copy");
+
+  if (runtime.get_target() == TARGET_CPP)
+    cpp_generate(out, refs);
+  else
+    code_generate(out);
+  if (timer)
+    timer->lap("code generation");
+
+  bool written = out.flush();
+  if (close(out_fd) != 0)
+    written = false;
+  if (timer)
+    timer->lap("output write");
+  if (!written) {
+    std::cerr << "Unable to write file: " << output_filename << std::endl;
+    return 0;
   }
+  std::cout << "Generated code to " << output_filename << std::endl;
+  return out.bytes() - runtime_bytes;
+}
+
+/*----------------------------------.
+|  Type-specialized code            |
+`----------------------------------*/
+
+// Where semant.cc has typed the operands as strings or ints, the runtime's
+// _str_* and _int_* functions are called instead of the generic ones. A
+// variable can still hold anything at run time, so those check the
+// run-time types themselves and fall back to the generic function: a wrong
+// static type only costs the fallback.
+
+// The typed function of a comparison or arithmetic, or nullptr
+static const char *typed_operation(Expression *e1, Symbol *op,
+                                   Expression *e2) {
+  static const struct {
+    Symbol **op;
+    const char *str_func, *int_func;
+  } funcs[] = {{&_ADD, "_str_add", "_int_add"}, {&_SUB, "_str_sub", "_int_sub"},
+               {&_EQ, "_str_eq", "_int_eq"},    {&_NE, "_str_ne", "_int_ne"},
+               {&_LT, "_str_lt", "_int_lt"},    {&_LE, "_str_le", "_int_le"},
+               {&_GT, "_str_gt", "_int_gt"},    {&_GE, "_str_ge", "_int_ge"}};
+  if (e1->type != e2->type || (e1->type != _string && e1->type != _int))
+    return nullptr;
+  for (const auto &func : funcs)
+    if (*func.op == op)
+      return e1->type == _string ? func.str_func : func.int_func;
+  return nullptr;
 }
 
-// Output generated code into ostring stream
-void Expression::code_generate(std::ostringstream &generated_code) {
-  generated_code << this->code_generate();
+// The typed function of a built-in called on a string, or nullptr
+static const char *typed_builtin(Direct_Call_Expr *call) {
+  static const std::pair<const char *, const char *> funcs[] = {
+      {"reverse", "_str_reverse"},
+      {"get_length", "_str_get_length"},
+      {"is_palindrome", "_str_is_palindrome"},
+      {"to_lower", "_str_to_lower"},
+      {"to_upper", "_str_to_upper"},
+      {"trim", "_str_trim"}};
+  if (call->id->is_nil() || call->id->type != _string ||
+      call->return_id->is_nil())
+    return nullptr;
+  const char *name = call->func_name->get_string();
+  if (strcmp(name, "concat") == 0)
+    return call->arg_list->size() == 1 &&
+                   call->arg_list->at(0)->type == _string
+               ? "_str_concat"
+               : nullptr;
+  if (!call->arg_list->empty())
+    return nullptr;
+  for (const auto &func : funcs)
+    if (strcmp(name, func.first) == 0)
+      return func.second;
+  return nullptr;
+}
+
+bool is_plain_say(Direct_Call_Expr *call) {
+  if (strcmp(call->func_name->get_string(), "say") != 0 ||
+      !call->id->is_nil() || call->arg_list->size() != 1)
+    return false;
+  Expression *arg = call->arg_list->at(0);
+  return dynamic_cast<Const_Expr *>(arg) || dynamic_cast<Arith_Expr *>(arg) ||
+         dynamic_cast<Comp_Expr *>(arg);
 }
 
 /*----------------------------------.
 |  code_generate() implementation   |
 `----------------------------------*/
 
-std::string Nil_Expr::code_generate() { return ""; }
+void Nil_Expr::code_generate(Code_Sink &out) {}
 
-std::string Single_Identifier::code_generate() {
-  // Construct Single_Identifer expression template params
-  std::unordered_map<std::string, std::string> params;
-  params["id"] = this->name->get_string();
-  return cg->generate("var", params);
+void Single_Identifier::code_generate(Code_Sink &out) {
+  emit<var_template>(out, this->name);
 }
 
-std::string Owner_Identifier::code_generate() {
-  std::unordered_map<std::string, std::string> params;
-  params["owner"] = this->owner_name->get_string();
-  params["prop"] = this->name->get_string();
-  return cg->generate("property", params);
+void Owner_Identifier::code_generate(Code_Sink &out) {
+  emit<property_template>(out, this->owner_name, this->name);
 }
 
-std::string Nil_Identifier::code_generate() { return ""; }
-
-std::string Var_Decl_Expr::code_generate() {
-  std::ostringstream buf;
-  std::unordered_map<std::string, std::string> params;
+void Nil_Identifier::code_generate(Code_Sink &out) {}
 
-  params.clear();
-  params["name"] = this->identifier->get_string();
-  params["init"] = this->init->code_generate();
+void Var_Decl_Expr::code_generate(Code_Sink &out) {
+  const char *type;
   if (this->init->type == _string)
-    params["type"] = "STRING";
+    type = "STRING";
   else if (this->init->type == _int)
-    params["type"] = "INT";
+    type = "INT";
   else if (this->init->type == _bool)
-    params["type"] = "BOOL";
+    type = "BOOL";
   else
-    params["type"] = "NULL_TYPE";
-  buf << cg->generate("var_decl", params);
-
-  return buf.str(); // to std:string
+    type = "NULL_TYPE";
+  emit<var_decl_template>(out, this->identifier, Code_Of{this->init}, type);
 }
 
-std::string Property_Decl_Expr::code_generate() {
-  std::ostringstream buf;
-  std::unordered_map<std::string, std::string> params;
+void Property_Decl_Expr::code_generate(Code_Sink &out) {
   // Assert this->identifier is a Single_Identifier
   Single_Identifier *si = static_cast<Single_Identifier *>(this->owner_id);
-
-  params.clear();
-  params["owner"] = si->name->get_string();
-  params["name"] = this->property_name->get_string();
-  buf << cg->generate("prop_decl", params);
-  return buf.str();
+  emit<prop_decl_template>(out, si->name, this->property_name);
 }
 
-std::string Assi_Expr::code_generate() {
-  std::unordered_map<std::string, std::string> params;
-
-  params["id"] = this->id->code_generate();
-  params["expr"] = this->expr->code_generate();
-  return cg->generate("assign", params);
+void Assi_Expr::code_generate(Code_Sink &out) {
+  emit<assign_template>(out, Code_Of{this->id}, Code_Of{this->expr});
 }
 
-std::string Cast_Expr::code_generate() {
+void Cast_Expr::code_generate(Code_Sink &out) {
   // Generation nothing if dest type is NULL_Type
   if (to_type == NULL_Type || to_type == _list)
-    return "";
+    return;
   // Generation nothing if source type = dest type
   if (id->type == to_type)
-    return "";
-
-  std::ostringstream buf;
-  std::unordered_map<std::string, std::string> params;
+    return;
 
   // Generate function name
   auto it = type_cast_map->find(std::make_pair(id->type, to_type));
   if (it == type_cast_map->end())
-    return ""; // Should never reach here
-  else
-    params["name"] = it->second;
+    return; // Should never reach here
 
-  buf << id->code_generate() << ", " << return_id->code_generate();
-  params["params"] = buf.str();
-  return cg->generate("func_call", params);
+  emit<func_call_template>(out, it->second, [this](Code_Sink &out) {
+    id->code_generate(out);
+    out += ", ";
+    return_id->code_generate(out);
+  });
 }
 
-std::string Direct_Call_Expr::code_generate() {
-  std::unordered_map<std::string, std::string> params;
-
-  params["name"] = this->func_name->get_string();
-
-  // Need to reverse the list, since yacc has collected args in inverse order
-  std::ostringstream arg_buf;
-  arg_buf << this->id->code_generate();
+void generate_params(Code_Sink &out, Direct_Call_Expr *call,
+                     void (Expression::*generate)(Code_Sink &)) {
+  Expression_List *arg_list = call->arg_list;
+  // Need to reverse the list, since yacc has collected args in inverse
+  // order
+  (call->id->*generate)(out);
 
   int arg_size = arg_list->size();
   // Adjust ','
   if (arg_size > 0) {
-    if (this->id->is_nil())
-      arg_buf << arg_list->at(arg_size - 1)->code_generate();
-    else
-      arg_buf << ", " << arg_list->at(arg_size - 1)->code_generate();
+    if (!call->id->is_nil())
+      out += ", ";
+    (arg_list->at(arg_size - 1)->*generate)(out);
   }
   // Append rest args
   if (arg_size > 1)
-    for (size_t i = arg_size - 1; i > 0; i--)
-      arg_buf << ", " << arg_list->at(i - 1)->code_generate();
+    for (size_t i = arg_size - 1; i > 0; i--) {
+      out += ", ";
+      (arg_list->at(i - 1)->*generate)(out);
+    }
   // Append return_id
-  if (!return_id->is_nil())
-    arg_buf << ", ";
-  arg_buf << this->return_id->code_generate();
-  params["params"] = arg_buf.str();
+  if (!call->return_id->is_nil())
+    out += ", ";
+  (call->return_id->*generate)(out);
+}
+
+void Direct_Call_Expr::code_generate(Code_Sink &out) {
+  if (is_plain_say(this)) {
+    emit<print_template>(out, Code_Of{arg_list->at(0)});
+    return;
+  }
 
-  return cg->generate("func_call", params);
+  auto params = [this](Code_Sink &out) { generate_params(out, this); };
+  if (const char *typed = typed_builtin(this))
+    emit<func_call_template>(out, typed, params);
+  else
+    emit<func_call_template>(out, this->func_name, params);
+}
+
+// _str_chain(s, t, trim, (concat, "!"), ...): a step is its built-in, or
+// concat with its argument
+void Chain_Call_Expr::code_generate(Code_Sink &out) {
+  emit<func_call_template>(out, "_str_chain", [this](Code_Sink &out) {
+    source->code_generate(out);
+    out += ", ";
+    return_id->code_generate(out);
+    for (Expression *expr : *steps) {
+      Direct_Call_Expr *step = static_cast<Direct_Call_Expr *>(expr);
+      out += ", ";
+      if (step->arg_list->empty()) {
+        emit_arg(out, step->func_name);
+        continue;
+      }
+      out += '(';
+      emit_arg(out, step->func_name);
+      out += ", ";
+      step->arg_list->at(0)->code_generate(out);
+      out += ')';
+    }
+  });
+}
+
+void Save_Expr::code_generate(Code_Sink &out) {
+  emit<save_template>(out, Code_Of{saved}, Code_Of{id});
 }
 
-std::string Cond_Call_Expr::code_generate() {
+// _reuse(saved, f, <the params of the call>)
+void Reused_Call_Expr::code_generate(Code_Sink &out) {
+  emit<func_call_template>(out, "_reuse", [this](Code_Sink &out) {
+    saved->code_generate(out);
+    out += ", ";
+    emit_arg(out, call->func_name);
+    out += ", ";
+    generate_params(out, call);
+  });
+}
+
+void Cond_Call_Expr::code_generate(Code_Sink &out) {
   std::cerr << "Here should not appear Cond_Call_Expr!" << std::endl;
-  return "";
 }
 
-std::string Cond_Expr::code_generate() {
-  std::unordered_map<std::string, std::string> params;
-  std::ostringstream buf;
+// One line per expression of a branch, one level deeper
+static void generate_branch(Code_Sink &out, Expression_List *list) {
+  out.indent();
+  for (Expression *expr : *list) {
+    expr->code_generate(out);
+    out.newline();
+  }
+  out.dedent();
+}
+
+void Cond_Expr::code_generate(Code_Sink &out) {
+  auto then_branch = [this](Code_Sink &out) {
+    generate_branch(out, _then_list);
+  };
+  if (!this->has_else) {
+    emit<if_template>(out, Code_Of{this->predictor}, then_branch);
+    return;
+  }
+  emit<if_else_template>(out, Code_Of{this->predictor}, then_branch,
+                         [this](Code_Sink &out) {
+                           generate_branch(out, _else_list);
+                         });
+}
 
-  params["condition"] = this->predictor->code_generate();
+// A comparison or arithmetic through func, typed or generic
+static void generate_operation(Code_Sink &out, const char *func,
+                               Expression *e1, Symbol *op, Expression *e2) {
+  if (const char *typed = typed_operation(e1, op, e2)) {
+    emit<func_call_template>(out, typed, [=](Code_Sink &out) {
+      e1->code_generate(out);
+      out += ", ";
+      e2->code_generate(out);
+    });
+    return;
+  }
+  emit<func_call_template>(out, func, [=](Code_Sink &out) {
+    e1->code_generate(out);
+    out += ", ";
+    e2->code_generate(out);
+    out += ", \"";
+    emit_arg(out, op);
+    out += '"';
+  });
+}
 
-  // Generate code of _then_list
-  for (Expression *expr : *_then_list)
-    buf << INTEND << expr->code_generate() << std::endl;
-  params["_then"] = buf.str();
+void Comp_Expr::code_generate(Code_Sink &out) {
+  generate_operation(out, COMP_FUNC_NAME, e1, op, e2);
+}
 
-  if (!this->has_else)
-    return cg->generate("if_statement", params);
+void Arith_Expr::code_generate(Code_Sink &out) {
+  generate_operation(out, ARITH_FUNC_NAME, e1, op, e2);
+}
 
-  // Generate code of else_list
-  buf.str("");
-  for (Expression *expr : *_else_list)
-    buf << INTEND << expr->code_generate() << std::endl;
-  params["_else"] = buf.str();
-  return cg->generate("if_else_statement", params);
+void String_Const_Expr::code_generate(Code_Sink &out) {
+  emit<string_template>(out, this->token);
 }
 
-std::string Comp_Expr::code_generate() {
-  std::unordered_map<std::string, std::string> params;
-  std::ostringstream buf;
+void Int_Const_Expr::code_generate(Code_Sink &out) {
+  emit<intnbool_template>(out, this->token);
+}
 
-  params["name"] = COMP_FUNC_NAME;
-  buf << this->e1->code_generate() << ", " << this->e2->code_generate() << ", "
-      << "\"" << this->op->get_string() << "\"";
-  params["params"] = buf.str();
-  return cg->generate("func_call", params);
+void Bool_Const_Expr::code_generate(Code_Sink &out) {
+  emit<intnbool_template>(out, this->value ? "True" : "False");
 }
 
-std::string Arith_Expr::code_generate() {
-  std::unordered_map<std::string, std::string> params;
-  std::ostringstream buf;
+/*----------------------------------.
+|   runtime_refs() implementation   |
+`----------------------------------*/
+
+void Nil_Expr::runtime_refs(Runtime_Refs &refs) {}
 
-  params["name"] = ARITH_FUNC_NAME;
-  buf << this->e1->code_generate() << ", " << this->e2->code_generate() << ", "
-      << "\"" << this->op->get_string() << "\"";
-  params["params"] = buf.str();
-  return cg->generate("func_call", params);
+// Such as _anonymous
+void Single_Identifier::runtime_refs(Runtime_Refs &refs) {
+  refs.add(name);
+  refs.add_variable(name);
 }
 
-std::string String_Const_Expr::code_generate() {
-  std::unordered_map<std::string, std::string> params;
+// Such as _anonymous_last_result
+void Owner_Identifier::runtime_refs(Runtime_Refs &refs) {
+  refs.add(owner_name, name);
+  refs.add_variable(owner_name, name);
+}
+
+void Nil_Identifier::runtime_refs(Runtime_Refs &refs) {}
 
-  params["value"] = this->token->get_string();
-  return cg->generate("string", params);
+void Var_Decl_Expr::runtime_refs(Runtime_Refs &refs) {
+  refs.add("SaytringVar");
+  refs.add("DataType");
+  refs.add_variable(identifier);
+  init->runtime_refs(refs);
 }
 
-std::string Int_Const_Expr::code_generate() {
-  std::unordered_map<std::string, std::string> params;
+void Property_Decl_Expr::runtime_refs(Runtime_Refs &refs) {
+  refs.add("SaytringVar");
+  refs.add_variable(static_cast<Single_Identifier *>(owner_id)->name,
+                    property_name);
+}
 
-  params["value"] = this->token->get_string();
-  return cg->generate("intnbool", params);
+void Assi_Expr::runtime_refs(Runtime_Refs &refs) {
+  id->runtime_refs(refs);
+  expr->runtime_refs(refs);
 }
 
-std::string Bool_Const_Expr::code_generate() {
-  std::unordered_map<std::string, std::string> params;
+// Mirrors Cast_Expr::code_generate()
+void Cast_Expr::runtime_refs(Runtime_Refs &refs) {
+  if (to_type == NULL_Type || to_type == _list || id->type == to_type)
+    return;
+  auto it = type_cast_map->find(std::make_pair(id->type, to_type));
+  if (it == type_cast_map->end())
+    return;
+  refs.add(it->second);
+  id->runtime_refs(refs);
+  return_id->runtime_refs(refs);
+}
 
-  if (this->value)
-    params["value"] = "True";
-  else
-    params["value"] = "False";
-  return cg->generate("intnbool", params);
+void Direct_Call_Expr::runtime_refs(Runtime_Refs &refs) {
+  if (const char *typed = typed_builtin(this))
+    refs.add(typed);
+  else if (!is_plain_say(this))
+    refs.add(func_name);
+  id->runtime_refs(refs);
+  for (Expression *arg : *arg_list)
+    arg->runtime_refs(refs);
+  return_id->runtime_refs(refs);
+}
+
+void Chain_Call_Expr::runtime_refs(Runtime_Refs &refs) {
+  refs.add("_str_chain");
+  // The C++ code stores a constant source in _anonymous first
+  if (!dynamic_cast<Identifier *>(source))
+    refs.add_variable(_anonymous);
+  source->runtime_refs(refs);
+  return_id->runtime_refs(refs);
+  for (Expression *expr : *steps) {
+    Direct_Call_Expr *step = static_cast<Direct_Call_Expr *>(expr);
+    refs.add(step->func_name);
+    for (Expression *arg : *step->arg_list)
+      arg->runtime_refs(refs);
+  }
+}
+
+void Save_Expr::runtime_refs(Runtime_Refs &refs) {
+  refs.add("SaytringVar");
+  id->runtime_refs(refs);
+  saved->runtime_refs(refs);
 }
+
+void Reused_Call_Expr::runtime_refs(Runtime_Refs &refs) {
+  refs.add("_reuse");
+  refs.add(call->func_name);
+  saved->runtime_refs(refs);
+  call->id->runtime_refs(refs);
+  for (Expression *arg : *call->arg_list)
+    arg->runtime_refs(refs);
+  call->return_id->runtime_refs(refs);
+}
+
+void Cond_Call_Expr::runtime_refs(Runtime_Refs &refs) {
+  predictor->runtime_refs(refs);
+  call_expr->runtime_refs(refs);
+}
+
+void Cond_Expr::runtime_refs(Runtime_Refs &refs) {
+  refs.add("_bool_wrap");
+  predictor->runtime_refs(refs);
+  for (Expression *expr : *_then_list)
+    expr->runtime_refs(refs);
+  for (Expression *expr : *_else_list)
+    expr->runtime_refs(refs);
+}
+
+void Comp_Expr::runtime_refs(Runtime_Refs &refs) {
+  const char *typed = typed_operation(e1, op, e2);
+  refs.add(typed ? typed : COMP_FUNC_NAME);
+  e1->runtime_refs(refs);
+  e2->runtime_refs(refs);
+}
+
+void Arith_Expr::runtime_refs(Runtime_Refs &refs) {
+  const char *typed = typed_operation(e1, op, e2);
+  refs.add(typed ? typed : ARITH_FUNC_NAME);
+  e1->runtime_refs(refs);
+  e2->runtime_refs(refs);
+}
+
+void String_Const_Expr::runtime_refs(Runtime_Refs &refs) {}
+
+void Int_Const_Expr::runtime_refs(Runtime_Refs &refs) {}
+
+void Bool_Const_Expr::runtime_refs(Runtime_Refs &refs) {}
@@ -0,0 +1,333 @@
+/*
+  Saytring Compiler. A compiler translating Saytring to Python.
+  Copyright (C) 2024 Haoyuan Li
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "AST.h"
+#include "cgen.h"
+#include "runtime.h"
+#include "sink.h"
+#include "symtab.h"
+#include "template.h"
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+#include <string_view>
+
+// The C++ backend, for --target cpp. It lowers the same checked and
+// optimized AST as cgen.cc to calls of runtime/runtime.h, a port of
+// runtime.py whose functions take the same arguments. Every variable is a
+// static SaytringVar defined up front, and the statements make up
+// program(), which run() calls the way a Python interpreter runs a script.
+
+extern Symbol *_string, *_int, *_bool, *NULL_Type, *_list;
+
+// from core_func.cc
+extern std::map<std::pair<Symbol *, Symbol *>, std::string> *type_cast_map;
+
+/*----------------------------------.
+|  Constants                        |
+`----------------------------------*/
+
+static void append_utf8(std::string &s, unsigned long cp) {
+  if (cp < 0x80) {
+    s += (char)cp;
+  } else if (cp < 0x800) {
+    s += (char)(0xC0 | (cp >> 6));
+    s += (char)(0x80 | (cp & 0x3F));
+  } else if (cp < 0x10000) {
+    s += (char)(0xE0 | (cp >> 12));
+    s += (char)(0x80 | ((cp >> 6) & 0x3F));
+    s += (char)(0x80 | (cp & 0x3F));
+  } else {
+    s += (char)(0xF0 | (cp >> 18));
+    s += (char)(0x80 | ((cp >> 12) & 0x3F));
+    s += (char)(0x80 | ((cp >> 6) & 0x3F));
+    s += (char)(0x80 | (cp & 0x3F));
+  }
+}
+
+// The code point of the n hex digits at text[pos], or -1
+static long hex_value(std::string_view text, size_t pos, size_t n) {
+  if (pos + n > text.size())
+    return -1;
+  long value = 0;
+  for (size_t i = pos; i < pos + n; i++) {
+    char c = text[i];
+    int digit = c >= '0' && c <= '9'   ? c - '0'
+                : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                : c >= 'A' && c <= 'F' ? c - 'A' + 10
+                                       : -1;
+    if (digit < 0)
+      return -1;
+    value = value * 16 + digit;
+  }
+  return value <= 0x10FFFF ? value : -1;
+}
+
+// The UTF-8 value of a string constant, whose escapes the lexer left in
+// Python's syntax. \N{name} is kept as it is, like unknown escapes.
+std::string python_string_value(std::string_view text) {
+  std::string value;
+  for (size_t pos = 0; pos < text.size();) {
+    if (text[pos] != '\\' || pos + 1 == text.size()) {
+      value += text[pos++];
+      continue;
+    }
+    char c = text[pos + 1];
+    const char *simple = "\\\\''\"\"a\ab\bf\fn\nr\rt\tv\v";
+    size_t hex_digits = c == 'x' ? 2 : c == 'u' ? 4 : c == 'U' ? 8 : 0;
+    bool found = false;
+    for (const char *p = simple; *p; p += 2)
+      if (*p == c) {
+        value += p[1];
+        pos += 2;
+        found = true;
+        break;
+      }
+    if (found)
+      continue;
+    if (c >= '0' && c <= '7') {
+      unsigned long cp = 0;
+      size_t end = pos + 1;
+      while (end < text.size() && end < pos + 4 && text[end] >= '0' &&
+             text[end] <= '7')
+        cp = cp * 8 + (text[end++] - '0');
+      append_utf8(value, cp);
+      pos = end;
+    } else if (hex_digits && hex_value(text, pos + 2, hex_digits) >= 0) {
+      append_utf8(value, hex_value(text, pos + 2, hex_digits));
+      pos += 2 + hex_digits;
+    } else {
+      value += '\\';
+      pos++;
+    }
+  }
+  return value;
+}
+
+// A string constant as the body of a C++ literal: anything but printable
+// ASCII is written as an octal escape, which never runs on into the next
+// character
+static void emit_cpp_string(Code_Sink &out, Symbol *token) {
+  std::string value =
+      python_string_value({token->get_string(), (size_t)token->get_len()});
+  std::string literal;
+  for (unsigned char c : value) {
+    if (c >= 0x20 && c < 0x7F && c != '"' && c != '\\' && c != '?') {
+      literal += (char)c;
+      continue;
+    }
+    char escape[8];
+    snprintf(escape, sizeof(escape), "\\%03o", c);
+    literal += escape;
+  }
+  emit<cpp_string_template>(out, std::string_view(literal));
+}
+
+/*----------------------------------.
+|  Statements                       |
+`----------------------------------*/
+
+// Expressions giving a value are statements of their own too
+static void cpp_statement(Code_Sink &out, Expression *expr) {
+  expr->cpp_generate(out);
+  if (dynamic_cast<Identifier *>(expr) || dynamic_cast<Const_Expr *>(expr) ||
+      dynamic_cast<Comp_Expr *>(expr) || dynamic_cast<Arith_Expr *>(expr))
+    out += ';';
+}
+
+// One line per expression of a branch, one level deeper
+static void cpp_branch(Code_Sink &out, Expression_List *list) {
+  out.indent();
+  for (Expression *expr : *list) {
+    cpp_statement(out, expr);
+    out.newline();
+  }
+  out.dedent();
+}
+
+void Program::cpp_generate(Code_Sink &out, const Runtime_Refs &refs) {
+  out.newline();
+  for (const std::string &variable : refs.get_variables()) {
+    emit<cpp_var_def_template>(out, std::string_view(variable));
+    out.newline();
+  }
+  out.newline();
+  emit<cpp_program_template>(
+      out, [this](Code_Sink &out) { cpp_branch(out, expr_list); });
+}
+
+/*----------------------------------.
+|  cpp_generate() implementation    |
+`----------------------------------*/
+
+void Nil_Expr::cpp_generate(Code_Sink &out) {}
+
+void Single_Identifier::cpp_generate(Code_Sink &out) {
+  emit<cpp_var_template>(out, this->name);
+}
+
+void Owner_Identifier::cpp_generate(Code_Sink &out) {
+  emit<cpp_property_template>(out, this->owner_name, this->name);
+}
+
+void Nil_Identifier::cpp_generate(Code_Sink &out) {}
+
+// A variable initializing another is refused by the semantic check
+void Var_Decl_Expr::cpp_generate(Code_Sink &out) {
+  const char *type;
+  if (this->init->type == _string)
+    type = "STRING";
+  else if (this->init->type == _int)
+    type = "INT";
+  else if (this->init->type == _bool)
+    type = "BOOL";
+  else
+    type = "NULL_TYPE";
+  emit<cpp_var_decl_template>(out, this->identifier, Cpp_Of{this->init},
+                              type);
+}
+
+void Property_Decl_Expr::cpp_generate(Code_Sink &out) {
+  // Assert this->identifier is a Single_Identifier
+  Single_Identifier *si = static_cast<Single_Identifier *>(this->owner_id);
+  emit<cpp_prop_decl_template>(out, si->name, this->property_name);
+}
+
+void Assi_Expr::cpp_generate(Code_Sink &out) {
+  emit<cpp_assign_template>(out, Cpp_Of{this->id}, Cpp_Of{this->expr});
+}
+
+// Mirrors Cast_Expr::code_generate()
+void Cast_Expr::cpp_generate(Code_Sink &out) {
+  if (to_type == NULL_Type || to_type == _list || id->type == to_type)
+    return;
+  auto it = type_cast_map->find(std::make_pair(id->type, to_type));
+  if (it == type_cast_map->end())
+    return; // Should never reach here
+
+  emit<cpp_func_call_template>(out, it->second, [this](Code_Sink &out) {
+    id->cpp_generate(out);
+    out += ", ";
+    return_id->cpp_generate(out);
+  });
+}
+
+// The C++ runtime has no typed built-ins, its generic ones are as fast
+void Direct_Call_Expr::cpp_generate(Code_Sink &out) {
+  if (is_plain_say(this)) {
+    emit<cpp_print_template>(out, Cpp_Of{arg_list->at(0)});
+    return;
+  }
+  emit<cpp_func_call_template>(out, this->func_name, [this](Code_Sink &out) {
+    generate_params(out, this, &Expression::cpp_generate);
+  });
+}
+
+// The steps one by one, which is what _str_chain() amounts to. A constant
+// source is stored in _anonymous for the first step to read, as it was
+// before fusing.
+void Chain_Call_Expr::cpp_generate(Code_Sink &out) {
+  if (!dynamic_cast<Identifier *>(source)) {
+    emit<cpp_assign_template>(
+        out, [](Code_Sink &out) { emit<cpp_var_template>(out, _anonymous); },
+        Cpp_Of{source});
+    out.newline();
+  }
+  for (size_t i = 0; i < steps->size(); i++) {
+    if (i > 0)
+      out.newline();
+    steps->at(i)->cpp_generate(out);
+  }
+}
+
+void Save_Expr::cpp_generate(Code_Sink &out) {
+  emit<cpp_save_template>(out, Cpp_Of{saved}, Cpp_Of{id});
+}
+
+// _reuse() of runtime.py: the call is made again only if one of the
+// variables it reads is NULL_TYPE
+void Reused_Call_Expr::cpp_generate(Code_Sink &out) {
+  auto inputs = [this](Code_Sink &out) {
+    const char *separator = "&";
+    if (!call->id->is_nil()) {
+      out += separator;
+      call->id->cpp_generate(out);
+      separator = ", &";
+    }
+    for (Expression *arg : *call->arg_list)
+      if (dynamic_cast<Identifier *>(arg)) {
+        out += separator;
+        arg->cpp_generate(out);
+        separator = ", &";
+      }
+  };
+  emit<cpp_reuse_template>(out, inputs, Cpp_Of{call->return_id},
+                           Cpp_Of{saved}, Cpp_Of{call});
+}
+
+void Cond_Call_Expr::cpp_generate(Code_Sink &out) {
+  std::cerr << "Here should not appear Cond_Call_Expr!" << std::endl;
+}
+
+void Cond_Expr::cpp_generate(Code_Sink &out) {
+  auto then_branch = [this](Code_Sink &out) { cpp_branch(out, _then_list); };
+  if (!this->has_else) {
+    emit<cpp_if_template>(out, Cpp_Of{this->predictor}, then_branch);
+    return;
+  }
+  emit<cpp_if_else_template>(
+      out, Cpp_Of{this->predictor}, then_branch,
+      [this](Code_Sink &out) { cpp_branch(out, _else_list); });
+}
+
+void Comp_Expr::cpp_generate(Code_Sink &out) {
+  emit<cpp_operation_template>(out, COMP_FUNC_NAME, Cpp_Of{e1}, Cpp_Of{e2},
+                               op);
+}
+
+void Arith_Expr::cpp_generate(Code_Sink &out) {
+  emit<cpp_operation_template>(out, ARITH_FUNC_NAME, Cpp_Of{e1}, Cpp_Of{e2},
+                               op);
+}
+
+void String_Const_Expr::cpp_generate(Code_Sink &out) {
+  emit_cpp_string(out, this->token);
+}
+
+// Ints are 64 bits in C++: a larger constant ends the program as an
+// overflow would
+void Int_Const_Expr::cpp_generate(Code_Sink &out) {
+  errno = 0;
+  long long value = strtoll(this->token->get_string(), nullptr, 10);
+  if (errno == ERANGE) {
+    out += "int_too_large()";
+    return;
+  }
+  if (value == LLONG_MIN) {
+    out += "Value(LLONG_MIN)";
+    return;
+  }
+  emit<cpp_int_template>(out, std::to_string(value));
+}
+
+void Bool_Const_Expr::cpp_generate(Code_Sink &out) {
+  emit<cpp_bool_template>(out, this->value ? "true" : "false");
+}
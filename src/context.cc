@@ -0,0 +1,130 @@
+/*
+  Saytring Compiler. A compiler translating Saytring to Python.
+  Copyright (C) 2024 Haoyuan Li
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "context.h"
+#include "source.h"
+
+thread_local Arena *ast_arena = nullptr;
+thread_local std::vector<AST_Node *> *ast_node_log = nullptr;
+
+// from lexer.l
+extern yyscan_t lexer_scan_source(Compile_Context *ctx, char *base,
+                                  size_t size);
+extern void lexer_destroy(yyscan_t scanner);
+
+// from parser.y
+extern int yyparse(yyscan_t scanner, Compile_Context *ctx);
+
+Compile_Context::Compile_Context(const std::string &input_filename,
+                                 std::ostream *diag)
+    : input_filename(input_filename), diag(diag),
+      env(this->input_filename.c_str(), diag) {
+  this->ast_root = nullptr;
+  this->node_log = nullptr;
+  this->has_pushed_back = false;
+  this->global_expr_list = nullptr;
+  this->temp_expr_list = nullptr;
+  this->temp_return_id = nullptr;
+  this->last_token = 0;
+  this->syntax_error_count = 0;
+  this->syntax_warn_count = 0;
+}
+
+Compile_Context::~Compile_Context() {
+  if (own_id_tab && id_tab == own_id_tab.get()) {
+    id_tab = &shared_id_tab;
+    str_tab = &shared_str_tab;
+    int_tab = &shared_int_tab;
+  }
+}
+
+void Compile_Context::own_symbols() {
+  own_id_tab.reset(new String_Tab(&shared_id_tab));
+  own_str_tab.reset(new String_Tab(&shared_str_tab));
+  own_int_tab.reset(new String_Tab(&shared_int_tab));
+}
+
+int Compile_Context::parse(char *base, size_t size) {
+  ast_arena = &arena;
+  ast_node_log = node_log;
+  id_tab = own_id_tab ? own_id_tab.get() : &shared_id_tab;
+  str_tab = own_str_tab ? own_str_tab.get() : &shared_str_tab;
+  int_tab = own_int_tab ? own_int_tab.get() : &shared_int_tab;
+  global_expr_list = new_expr_list();
+
+  yyscan_t scanner = lexer_scan_source(this, base, size);
+  int result = yyparse(scanner, this);
+  lexer_destroy(scanner);
+  return result;
+}
+
+void Compile_Context::semant_check() { ast_root->semant_check(&env); }
+
+void Compile_Context::fold_constants() { ast_root->fold_constants(); }
+
+void Compile_Context::fuse_chains() { ast_root->fuse_chains(); }
+
+void Compile_Context::reuse_calls() { ast_root->reuse_calls(); }
+
+void Compile_Context::hoist_setup() { ast_root->hoist_setup(); }
+
+bool Compile_Context::check(char *base, size_t size) {
+  std::ostream &log = *diag;
+  const std::string &input = input_filename;
+
+  int parse_return = parse(base, size);
+  if (syntax_warn_count > 0)
+    log << input << ": " << syntax_warn_count
+        << " syntax warnings detected, which may lead to unexpected "
+           "behavior.\n";
+  if (parse_return != 0 || syntax_error_count > 0) {
+    log << input << ": Compilation terminated due to " << syntax_error_count
+        << " syntax errors.\n";
+    release();
+    return false;
+  }
+
+  semant_check();
+  if (env.warn_count > 0)
+    log << input << ": " << env.warn_count
+        << " semant warnings detected, which may lead to unexpected "
+           "behavior.\n";
+  if (env.error_count > 0) {
+    log << input << ": Compilation terminated due to " << env.error_count
+        << " semantic errors.\n";
+    release();
+    return false;
+  }
+
+  fold_constants();
+  fuse_chains();
+  reuse_calls();
+  return true;
+}
+
+void Compile_Context::generate(Code_Sink &out, const Runtime &runtime) {
+  ast_root->code_generate(out, runtime);
+  release();
+}
+
+void Compile_Context::release() {
+  arena.release();
+  ast_root = nullptr;
+  global_expr_list = temp_expr_list = nullptr;
+  temp_return_id = nullptr;
+  temp_call_list.clear();
+}
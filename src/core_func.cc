@@ -19,6 +19,7 @@
 #include "semant.h"
 #include "symtab.h"
 #include <map>
+#include <mutex>
 #include <string>
 #include <utility>
 
@@ -27,8 +28,24 @@
   std::make_pair(std::make_pair(t1, t2), func_name))
 
 auto *type_cast_map = new std::map<std::pair<Symbol *, Symbol *>, std::string>;
+Func_Map *buildin_func_map = new Func_Map;
 
+static std::once_flag type_cast_map_installed;
+static std::once_flag buildin_func_installed;
+
+static void do_install_type_cast_map();
+static void do_install_buildin_func();
+
+// Both tables are shared read-only by every compilation, fill them only once
 void install_type_cast_map() {
+  std::call_once(type_cast_map_installed, do_install_type_cast_map);
+}
+
+void install_buildin_func() {
+  std::call_once(buildin_func_installed, do_install_buildin_func);
+}
+
+static void do_install_type_cast_map() {
   type_cast_map->insert(TYPE_CAST_MAP_ENTRY(_int, _string, "cast_int_to_str");
   type_cast_map->insert(TYPE_CAST_MAP_ENTRY(_int, _bool, "cast_int_to_bool");
   type_cast_map->insert(TYPE_CAST_MAP_ENTRY(_string, _int, "cast_str_to_int");
@@ -42,7 +59,7 @@ void install_type_cast_map() {
   type_cast_map->insert(TYPE_CAST_MAP_ENTRY(NULL_Type, _string, "cast_null_to_str");
 }
 
-void install_buildin_func() {
+static void do_install_buildin_func() {
   std::vector<Symbol *> *arg_list;
 
   // Type-cast Functions
@@ -50,70 +67,70 @@ void install_buildin_func() {
   arg_list = new std::vector<Symbol *>;
   arg_list->push_back(_int);
   arg_list->push_back(_string); // return_type
-  Env::func_map->insert(
+  buildin_func_map->insert(
       std::make_pair(id_tab->add_string("cast_int_to_str"), arg_list));
 
   // cast_bool_to_str(NULL_Type) : string
   arg_list = new std::vector<Symbol *>;
   arg_list->push_back(_bool);
   arg_list->push_back(_string); // return_type
-  Env::func_map->insert(
+  buildin_func_map->insert(
       std::make_pair(id_tab->add_string("cast_bool_to_str"), arg_list));
 
   // cast_list_to_str(NULL_Type) : string
   arg_list = new std::vector<Symbol *>;
   arg_list->push_back(_list);
   arg_list->push_back(_string); // return_type
-  Env::func_map->insert(
+  buildin_func_map->insert(
       std::make_pair(id_tab->add_string("cast_list_to_str"), arg_list));
 
   // cast_null_to_str(NULL_Type) : string
   arg_list = new std::vector<Symbol *>;
   arg_list->push_back(NULL_Type);
   arg_list->push_back(_string); // return_type
-  Env::func_map->insert(
+  buildin_func_map->insert(
       std::make_pair(id_tab->add_string("cast_null_to_str"), arg_list));
 
   // cast_null_to_int(NULL_Type) : int
   arg_list = new std::vector<Symbol *>;
   arg_list->push_back(NULL_Type);
   arg_list->push_back(_int); // return_type
-  Env::func_map->insert(
+  buildin_func_map->insert(
       std::make_pair(id_tab->add_string("cast_null_to_int"), arg_list));
 
   // cast_null_to_bool(NULL_Type) : bool
   arg_list = new std::vector<Symbol *>;
   arg_list->push_back(NULL_Type);
   arg_list->push_back(_bool); // return_type
-  Env::func_map->insert(
+  buildin_func_map->insert(
       std::make_pair(id_tab->add_string("cast_null_to_bool"), arg_list));
 
   // cast_str_to_bool(string) : bool
   arg_list = new std::vector<Symbol *>;
   arg_list->push_back(_string);
   arg_list->push_back(_bool); // return_type
-  Env::func_map->insert(
+  buildin_func_map->insert(
       std::make_pair(id_tab->add_string("cast_str_to_bool"), arg_list));
 
   // cast_str_to_int(string) : int
   arg_list = new std::vector<Symbol *>;
   arg_list->push_back(_string);
   arg_list->push_back(_int); // return_type
-  Env::func_map->insert(
+  buildin_func_map->insert(
       std::make_pair(id_tab->add_string("cast_str_to_int"), arg_list));
 
   // cast_int_to_bool(int) : bool
   arg_list = new std::vector<Symbol *>;
   arg_list->push_back(_int);
   arg_list->push_back(_bool); // return_type
-  Env::func_map->insert(
+  buildin_func_map->insert(
       std::make_pair(id_tab->add_string("cast_int_to_bool"), arg_list));
 
   // cast_bool_to_int(bool) : int
   arg_list = new std::vector<Symbol *>;
   arg_list->push_back(_bool);
   arg_list->push_back(_int); // return_type
-  Env::func_map->insert(
+  buildin_func_map->insert(
       std::make_pair(id_tab->add_string("cast_bool_to_int"), arg_list));
 
   // concat(string, string) : string
@@ -121,7 +138,8 @@ void install_buildin_func() {
   arg_list->push_back(_string);
   arg_list->push_back(_string);
   arg_list->push_back(_string); // return_type
-  Env::func_map->insert(std::make_pair(id_tab->add_string("concat"), arg_list));
+  buildin_func_map->insert(
+      std::make_pair(id_tab->add_string("concat"), arg_list));
 
   // substring(string, int, int) : string
   arg_list = new std::vector<Symbol *>;
@@ -129,7 +147,7 @@ void install_buildin_func() {
   arg_list->push_back(_int);
   arg_list->push_back(_int);
   arg_list->push_back(_string); // return_type
-  Env::func_map->insert(
+  buildin_func_map->insert(
       std::make_pair(id_tab->add_string("substring"), arg_list));
 
   // substring_from_start(string, int) : string  override
@@ -137,28 +155,28 @@ void install_buildin_func() {
   arg_list->push_back(_string);
   arg_list->push_back(_int);
   arg_list->push_back(_string); // return_type
-  Env::func_map->insert(
+  buildin_func_map->insert(
       std::make_pair(id_tab->add_string("substring_from_start"), arg_list));
 
   // get_length(string) : int
   arg_list = new std::vector<Symbol *>;
   arg_list->push_back(_string);
   arg_list->push_back(_int);
-  Env::func_map->insert(
+  buildin_func_map->insert(
       std::make_pair(id_tab->add_string("get_length"), arg_list));
 
   // reverse(string) : string
   arg_list = new std::vector<Symbol *>;
   arg_list->push_back(_string);
   arg_list->push_back(_string); // return_type
-  Env::func_map->insert(
+  buildin_func_map->insert(
       std::make_pair(id_tab->add_string("reverse"), arg_list));
 
   // is_palindrome(string) : bool
   arg_list = new std::vector<Symbol *>;
   arg_list->push_back(_string);
   arg_list->push_back(_bool); // return_type
-  Env::func_map->insert(
+  buildin_func_map->insert(
       std::make_pair(id_tab->add_string("is_palindrome"), arg_list));
 
   // say(NULL_Type, string) : NULL_Type
@@ -166,20 +184,22 @@ void install_buildin_func() {
   arg_list->push_back(NULL_Type);
   arg_list->push_back(_string);
   arg_list->push_back(NULL_Type);
-  Env::func_map->insert(std::make_pair(id_tab->add_string("say"), arg_list));
+  buildin_func_map->insert(
+      std::make_pair(id_tab->add_string("say"), arg_list));
 
   // ask(NULL_Type) : NULL_Type
   arg_list = new std::vector<Symbol *>;
   arg_list->push_back(NULL_Type);
   arg_list->push_back(NULL_Type);
-  Env::func_map->insert(std::make_pair(id_tab->add_string("ask"), arg_list));
+  buildin_func_map->insert(
+      std::make_pair(id_tab->add_string("ask"), arg_list));
 
   // ask_with_prompt(NULL_Type, string) : NULL_Type
   arg_list = new std::vector<Symbol *>;
   arg_list->push_back(NULL_Type);
   arg_list->push_back(_string);
   arg_list->push_back(NULL_Type);
-  Env::func_map->insert(
+  buildin_func_map->insert(
       std::make_pair(id_tab->add_string("ask_with_prompt"), arg_list));
 
   // replace(string, string, string) : string
@@ -188,7 +208,7 @@ void install_buildin_func() {
   arg_list->push_back(_string);
   arg_list->push_back(_string);
   arg_list->push_back(_string);
-  Env::func_map->insert(
+  buildin_func_map->insert(
       std::make_pair(id_tab->add_string("replace"), arg_list));
 
   // find(string, string) : int
@@ -196,46 +216,56 @@ void install_buildin_func() {
   arg_list->push_back(_string);
   arg_list->push_back(_string);
   arg_list->push_back(_int);
-  Env::func_map->insert(std::make_pair(id_tab->add_string("find"), arg_list));
+  buildin_func_map->insert(
+      std::make_pair(id_tab->add_string("find"), arg_list));
 
   // to_lower(string) : string
   arg_list = new std::vector<Symbol *>;
   arg_list->push_back(_string);
   arg_list->push_back(_string);
-  Env::func_map->insert(
+  buildin_func_map->insert(
       std::make_pair(id_tab->add_string("to_lower"), arg_list));
 
   // to_upper(string) : string
   arg_list = new std::vector<Symbol *>;
   arg_list->push_back(_string);
   arg_list->push_back(_string);
-  Env::func_map->insert(
+  buildin_func_map->insert(
       std::make_pair(id_tab->add_string("to_upper"), arg_list));
 
   // trim(string) : string
   arg_list = new std::vector<Symbol *>;
   arg_list->push_back(_string);
   arg_list->push_back(_string);
-  Env::func_map->insert(std::make_pair(id_tab->add_string("trim"), arg_list));
+  buildin_func_map->insert(
+      std::make_pair(id_tab->add_string("trim"), arg_list));
 
   // split(string, string) : list
   arg_list = new std::vector<Symbol *>;
   arg_list->push_back(_string);
   arg_list->push_back(_string);
   arg_list->push_back(_list);
-  Env::func_map->insert(std::make_pair(id_tab->add_string("split"), arg_list));
+  buildin_func_map->insert(
+      std::make_pair(id_tab->add_string("split"), arg_list));
 
   // get_at(list, int) : string
   arg_list = new std::vector<Symbol *>;
   arg_list->push_back(_list);
   arg_list->push_back(_int);
   arg_list->push_back(_string);
-  Env::func_map->insert(std::make_pair(id_tab->add_string("get_at"), arg_list));
+  buildin_func_map->insert(
+      std::make_pair(id_tab->add_string("get_at"), arg_list));
 }
 
-void install_buildin_var() {
+void install_buildin_var(Env *env) {
   // Install anonymous variable
-  Env::id_map->insert(std::make_pair(_anonymous, NULL_Type));
-  Env::property_map->insert(
+  env->id_map.insert(std::make_pair(_anonymous, NULL_Type));
+  env->property_map.insert(
       std::make_pair(std::make_pair(_anonymous, LAST_RESULT), NULL_Type));
+  // The line of input being run on
+  if (env->record_mode) {
+    env->id_map.insert(std::make_pair(RECORD, _string));
+    env->property_map.insert(
+        std::make_pair(std::make_pair(RECORD, LAST_RESULT), NULL_Type));
+  }
 }
@@ -0,0 +1,312 @@
+/*
+  Saytring Compiler. A compiler translating Saytring to Python.
+  Copyright (C) 2024 Haoyuan Li
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "image.h"
+#include "util.h"
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+static size_t align8(size_t n) { return (n + 7) & ~(size_t)7; }
+
+/*----------------------------------.
+|  Writing                          |
+`----------------------------------*/
+
+bool VM_Image::write(const VM_Program &program, const char *filename) {
+  // Each string once
+  std::string pool;
+  std::unordered_map<std::string, uint32_t> pooled;
+  auto add = [&](const std::string &s) {
+    auto it = pooled.find(s);
+    if (it == pooled.end()) {
+      it = pooled.emplace(s, (uint32_t)pool.size()).first;
+      pool += s;
+    }
+    return VM_Image_String{it->second, (uint32_t)s.size()};
+  };
+  std::vector<VM_Image_Constant> constants;
+  for (const VM_Constant &c : program.constants)
+    constants.push_back({c.reg, c.kind, c.i,
+                         c.kind == VM_Constant::STR ? add(c.s)
+                                                    : VM_Image_String{0, 0}});
+  std::vector<VM_Image_String> slots;
+  for (const std::string &name : program.slot_names)
+    slots.push_back(add(name));
+
+  VM_Image_Header h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, VM_IMAGE_MAGIC, sizeof(h.magic));
+  h.format = VM_IMAGE_FORMAT;
+  h.byte_order = VM_IMAGE_BYTE_ORDER;
+  strncpy(h.compiler, _VERSION_, sizeof(h.compiler) - 1);
+  size_t offset = align8(sizeof(h));
+  h.code_offset = offset;
+  h.code_length = program.code.size();
+  offset = align8(offset + program.code.size() * sizeof(int32_t));
+  h.constants_offset = offset;
+  h.constant_count = constants.size();
+  offset = align8(offset + constants.size() * sizeof(VM_Image_Constant));
+  h.slots_offset = offset;
+  h.slot_count = slots.size();
+  offset = align8(offset + slots.size() * sizeof(VM_Image_String));
+  h.pool_offset = offset;
+  h.pool_size = pool.size();
+  h.register_count = program.register_count;
+  h.record_slot = program.record_slot;
+  h.body = program.body;
+  h.independent = program.independent;
+  offset += pool.size();
+  if (offset > UINT32_MAX) {
+    std::cerr << "Error: The program is too large to precompile." << std::endl;
+    return false;
+  }
+  h.size = offset;
+
+  std::string image(offset, '\0');
+  memcpy(&image[0], &h, sizeof(h));
+  memcpy(&image[h.code_offset], program.code.data(),
+         program.code.size() * sizeof(int32_t));
+  memcpy(&image[h.constants_offset], constants.data(),
+         constants.size() * sizeof(VM_Image_Constant));
+  memcpy(&image[h.slots_offset], slots.data(),
+         slots.size() * sizeof(VM_Image_String));
+  memcpy(&image[h.pool_offset], pool.data(), pool.size());
+
+  std::string tmp = std::string(filename) + ".tmp." + std::to_string(getpid());
+  std::ofstream out(tmp, std::ios::binary);
+  out << image;
+  out.close();
+  if (!out || rename(tmp.c_str(), filename) != 0) {
+    remove(tmp.c_str());
+    perror("Failed to write the precompiled program");
+    return false;
+  }
+  return true;
+}
+
+/*----------------------------------.
+|  Loading                          |
+`----------------------------------*/
+
+bool VM_Image::open(const char *filename) {
+  close();
+  int fd = ::open(filename, O_RDONLY);
+  if (fd < 0) {
+    perror("Failed to open file");
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+      (size_t)st.st_size < sizeof(VM_Image_Header)) {
+    ::close(fd);
+    std::cerr << "Error: " << filename
+              << " is not a precompiled Saytring program." << std::endl;
+    return false;
+  }
+  void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED) {
+    perror("Failed to map file");
+    return false;
+  }
+  base = (const char *)p;
+  size = st.st_size;
+  if (!check(filename)) {
+    close();
+    return false;
+  }
+  return true;
+}
+
+void VM_Image::close() {
+  if (base == nullptr)
+    return;
+  munmap((void *)base, size);
+  base = nullptr;
+  size = 0;
+}
+
+// Whether count elements of size bytes at offset, aligned to align, are in
+// an image of image_size bytes
+static bool in_image(size_t image_size, uint64_t offset, uint64_t count,
+                     size_t size, size_t align) {
+  return offset % align == 0 && offset <= image_size &&
+         count <= (image_size - offset) / size;
+}
+
+// Whether the instructions only name slots, registers and positions of
+// instructions there are, and end with HALT, as does the setup before body
+// in record mode. Jumps go forward, as the compiler makes them, so that
+// the program always ends.
+static bool check_code(const int32_t *code, size_t length, int32_t slots,
+                       int32_t registers, size_t body) {
+  const char *const *operands = vm_operand_kinds;
+  // Where the instructions start
+  std::vector<bool> starts(length, false);
+  size_t last = length;
+  for (size_t pos = 0; pos < length;) {
+    if (code[pos] < 0 || code[pos] >= OP_COUNT)
+      return false;
+    starts[pos] = true;
+    last = pos;
+    size_t next = pos + 1 + strlen(operands[code[pos]]);
+    if (code[pos] == OP_REUSE) {
+      if (next > length || code[pos + 4] < 0)
+        return false;
+      next += code[pos + 4];
+    }
+    if (next > length)
+      return false;
+    pos = next;
+  }
+  if (last == length || code[last] != OP_HALT)
+    return false;
+  if (body > 0 && (body >= length || !starts[body] || !starts[body - 1] ||
+                   code[body - 1] != OP_HALT))
+    return false;
+
+  for (size_t pos = 0; pos < length; pos++) {
+    if (!starts[pos])
+      continue;
+    const char *kinds = operands[code[pos]];
+    for (size_t i = 0; kinds[i]; i++) {
+      int32_t x = code[pos + 1 + i];
+      bool ok;
+      switch (kinds[i]) {
+      case 'V':
+        ok = x >= 0 && x < slots;
+        break;
+      case 'A':
+        ok = x >= 0 ? x < slots : ~x < registers;
+        break;
+      case 'R':
+        ok = x < 0 && ~x < registers;
+        break;
+      case 'J':
+        ok = x >= 0 && (size_t)x > pos && (size_t)x < length && starts[x];
+        break;
+      case 'O':
+        ok = x >= 0 && x < 8;
+        break;
+      case 'T':
+        ok = x >= 1 && x <= 5;
+        break;
+      case 'N':
+        ok = true;
+        for (int32_t j = 0; j < x; j++) {
+          int32_t slot = code[pos + 2 + i + j];
+          ok = ok && slot >= 0 && slot < slots;
+        }
+        break;
+      default:
+        ok = false;
+      }
+      if (!ok)
+        return false;
+    }
+  }
+  return true;
+}
+
+bool VM_Image::check(const char *filename) const {
+  const VM_Image_Header *h = header();
+  if (memcmp(h->magic, VM_IMAGE_MAGIC, sizeof(h->magic)) != 0) {
+    std::cerr << "Error: " << filename
+              << " is not a precompiled Saytring program." << std::endl;
+    return false;
+  }
+  if (h->format != VM_IMAGE_FORMAT || h->byte_order != VM_IMAGE_BYTE_ORDER ||
+      strncmp(h->compiler, _VERSION_, sizeof(h->compiler)) != 0) {
+    std::cerr << "Error: " << filename
+              << " was precompiled by another version of saytringc, or on "
+                 "another kind of machine. Precompile it again."
+              << std::endl;
+    return false;
+  }
+
+  bool ok =
+      h->size == size &&
+      in_image(size, h->code_offset, h->code_length, sizeof(int32_t), 8) &&
+      in_image(size, h->constants_offset, h->constant_count,
+               sizeof(VM_Image_Constant), 8) &&
+      in_image(size, h->slots_offset, h->slot_count, sizeof(VM_Image_String),
+               8) &&
+      in_image(size, h->pool_offset, h->pool_size, 1, 1) &&
+      // The slots section holds a name for each slot, so the size of the
+      // file bounds slot_count. A register is a constant or the result of
+      // an instruction, so a damaged count cannot make run() allocate more
+      // registers than the file has words.
+      (uint64_t)h->register_count <=
+          (uint64_t)h->constant_count + h->code_length &&
+      h->record_slot >= -1 && h->record_slot < (int64_t)h->slot_count &&
+      (h->record_slot >= 0 || (h->body == 0 && h->independent == 0)) &&
+      h->independent <= 1;
+  if (ok) {
+    const VM_Image_Constant *constants =
+        (const VM_Image_Constant *)(base + h->constants_offset);
+    const VM_Image_String *slots =
+        (const VM_Image_String *)(base + h->slots_offset);
+    for (uint32_t i = 0; ok && i < h->constant_count; i++)
+      ok = constants[i].reg >= 0 &&
+           (uint32_t)constants[i].reg < h->register_count &&
+           constants[i].kind >= VM_Constant::INT &&
+           constants[i].kind <= VM_Constant::BOOL &&
+           in_image(h->pool_size, constants[i].s.offset, constants[i].s.length,
+                    1, 1);
+    for (uint32_t i = 0; ok && i < h->slot_count; i++)
+      ok = in_image(h->pool_size, slots[i].offset, slots[i].length, 1, 1);
+    ok = ok && check_code((const int32_t *)(base + h->code_offset),
+                          h->code_length, h->slot_count, h->register_count,
+                          h->body);
+  }
+  if (!ok)
+    std::cerr << "Error: " << filename
+              << " is a damaged precompiled Saytring program." << std::endl;
+  return ok;
+}
+
+/*----------------------------------.
+|  Running                          |
+`----------------------------------*/
+
+// The code runs in place; only the constants are copied out, into Values
+int VM_Image::run(int records, unsigned jobs) const {
+  const VM_Image_Header *h = header();
+  const VM_Image_Constant *image_constants =
+      (const VM_Image_Constant *)(base + h->constants_offset);
+  const char *pool = base + h->pool_offset;
+  std::vector<VM_Constant> constants;
+  constants.reserve(h->constant_count);
+  for (uint32_t i = 0; i < h->constant_count; i++) {
+    const VM_Image_Constant &c = image_constants[i];
+    constants.push_back({c.reg, (VM_Constant::Kind)c.kind, c.i,
+                         std::string(pool + c.s.offset, c.s.length)});
+  }
+  VM_Layout layout = {(int32_t)h->slot_count, (int32_t)h->register_count,
+                      h->record_slot, (int32_t)h->body, h->independent != 0};
+  return vm_run((const int32_t *)(base + h->code_offset), layout, constants,
+                records, jobs);
+}
@@ -18,16 +18,50 @@
 #ifndef _AST_H_
 #define _AST_H_
 
+#include <cstdint>
 #include <iostream>
 #include <sstream>
 #include <vector>
+#include "arena.h"
 #include "parser.tab.h"
 #include "symtab.h"
 
+class Code_Sink;
+class Env;
+class Runtime;
+class Runtime_Refs;
+class Time_Report;
+class VM_Builder;
+struct VM_Program;
+
+// Owns every AST node and Expression_List of the translation unit. Bound by
+// the Compile_Context being worked on by this thread.
+extern thread_local Arena *ast_arena;
+class AST_Node;
+// If set, every AST node created by this thread is appended, for
+// --mem-report
+extern thread_local std::vector<AST_Node *> *ast_node_log;
+
+// Expression_List is declared in parser.y, since %union needs it
+inline Expression_List *new_expr_list() {
+  return new (*ast_arena) Expression_List(ast_arena);
+}
+
 class AST_Node {
 public:
   YYLTYPE location;
-  AST_Node(YYLTYPE loc) { this->location = loc; }
+  AST_Node(YYLTYPE loc) {
+    this->location = loc;
+    if (ast_node_log)
+      ast_node_log->push_back(this);
+  }
+  // Never run, as the arena is released as a whole. Being virtual makes
+  // every node polymorphic, so that typeid() tells its class.
+  virtual ~AST_Node() {}
+
+  // AST nodes are carved from ast_arena and freed all at once
+  static void *operator new(size_t size) { return ast_arena->allocate(size); }
+  static void operator delete(void *) {}
 };
 
 /////////////////////////////////////////////
@@ -36,30 +70,77 @@ public:
 
 class Program : public AST_Node {
 public:
-  std::vector<class Expression *> *expr_list;
-  Program(std::vector<Expression *> *expr, YYLTYPE loc) : AST_Node(loc) {
+  Expression_List *expr_list;
+  // In record mode, the statements run once before the first record,
+  // hoisted out of expr_list by hoist_setup(). nullptr otherwise.
+  Expression_List *setup_list;
+  Program(Expression_List *expr, YYLTYPE loc) : AST_Node(loc) {
     this->expr_list = expr;
+    this->setup_list = nullptr;
   }
 
-  void semant_check();
-  void code_generation();
+  void semant_check(Env *env);
+  // Fold constant expressions and drop the dead branches of constant
+  // conditionals. Runs after semant_check(), only on a checked program.
+  void fold_constants();
+  // Fuse the chains of string built-ins into Chain_Call_Exprs. Runs after
+  // fold_constants().
+  void fuse_chains();
+  // Reuse the results of earlier calls of pure built-ins on unchanged
+  // inputs. Runs after fuse_chains().
+  void reuse_calls();
+  // Turn on record mode, in which expr_list runs once per line of input,
+  // the line in the variable record. The declarations of constants no
+  // other statement stores into are moved to setup_list. Runs after
+  // reuse_calls().
+  void hoist_setup();
+  void code_generate(Code_Sink &out);
+  void runtime_refs(Runtime_Refs &refs);
+  // The C++ program: a definition of every variable in refs, then a
+  // program() run by main()
+  void cpp_generate(Code_Sink &out, const Runtime_Refs &refs);
+  // Write the part of runtime the program uses, then its code, to
+  // output_filename. Laps "runtime copy", "code generation" and "output
+  // write" on timer. Return the number of bytes generated, runtime
+  // excluded.
+  size_t code_generation(const char *output_filename, const Runtime &runtime,
+                         Time_Report *timer = nullptr);
+  // Append the part of runtime the program uses, then its code, to out.
+  // The code is in the target language of runtime.
+  void code_generate(Code_Sink &out, const Runtime &runtime);
+  // Compile the program to the bytecode of the VM running it for --run.
+  // Return false if it cannot be run the way python would run it.
+  bool vm_compile(VM_Program &out);
 };
 
 /////////////// Expression //////////////////
 class Expression : public AST_Node {
 public:
-  Symbol *type;
-  Expression(YYLTYPE loc) : AST_Node(loc) {}
-  virtual Symbol *type_check() = 0;
-  void code_generate(std::ostringstream &generated_code);
-  virtual std::string code_generate() = 0;
+  Symbol *type; // nullptr until type-checked
+  Expression(YYLTYPE loc) : AST_Node(loc), type(nullptr) {}
+  virtual Symbol *type_check(Env *env) = 0;
+  // Return the expression with its constant subexpressions folded, which
+  // may be a new node to replace it with
+  virtual Expression *fold() { return this; }
+  // Append the code of the expression to out
+  virtual void code_generate(Code_Sink &out) = 0;
+  // Append the C++ code of the expression to out, for --target cpp
+  virtual void cpp_generate(Code_Sink &out) = 0;
+  // Append the bytecode of the expression, for --run. Return the operand
+  // holding its value, VM_NO_VALUE for none.
+  virtual int32_t vm_compile(VM_Builder &b) = 0;
+  // Add the runtime definitions the code of the expression refers to
+  virtual void runtime_refs(Runtime_Refs &refs) = 0;
 };
 
 class Nil_Expr : public Expression {
 public:
   Nil_Expr(YYLTYPE loc) : Expression(loc) {}
-  Symbol *type_check();
-  std::string code_generate();
+  Symbol *type_check(Env *env);
+  void code_generate(Code_Sink &out);
+  void cpp_generate(Code_Sink &out);
+  int32_t vm_compile(VM_Builder &b);
+  void runtime_refs(Runtime_Refs &refs);
 };
 
 /////////////// Identifier //////////////////
@@ -68,8 +149,11 @@ public:
   Identifier(YYLTYPE loc) : Expression(loc) {}
   virtual bool has_owner() = 0;
   virtual bool is_nil() = 0;
-  virtual Symbol *type_check() = 0;
-  virtual std::string code_generate() = 0;
+  virtual Symbol *type_check(Env *env) = 0;
+  virtual void code_generate(Code_Sink &out) = 0;
+  virtual void cpp_generate(Code_Sink &out) = 0;
+  virtual int32_t vm_compile(VM_Builder &b) = 0;
+  virtual void runtime_refs(Runtime_Refs &refs) = 0;
 };
 
 class Single_Identifier : public Identifier {
@@ -82,8 +166,11 @@ public:
   Single_Identifier(YYLTYPE loc) : Identifier(loc) {}
   bool has_owner() { return false; }
   bool is_nil() { return false; }
-  Symbol *type_check();
-  std::string code_generate();
+  Symbol *type_check(Env *env);
+  void code_generate(Code_Sink &out);
+  void cpp_generate(Code_Sink &out);
+  int32_t vm_compile(VM_Builder &b);
+  void runtime_refs(Runtime_Refs &refs);
 };
 
 class Owner_Identifier : public Identifier {
@@ -97,8 +184,11 @@ public:
   }
   bool has_owner() { return true; }
   bool is_nil() { return false; }
-  Symbol *type_check();
-  std::string code_generate();
+  Symbol *type_check(Env *env);
+  void code_generate(Code_Sink &out);
+  void cpp_generate(Code_Sink &out);
+  int32_t vm_compile(VM_Builder &b);
+  void runtime_refs(Runtime_Refs &refs);
 };
 
 class Nil_Identifier : public Identifier {
@@ -106,16 +196,22 @@ public:
   Nil_Identifier(YYLTYPE loc) : Identifier(loc) {}
   bool has_owner() { return false; }
   bool is_nil() { return true; }
-  Symbol *type_check();
-  std::string code_generate();
+  Symbol *type_check(Env *env);
+  void code_generate(Code_Sink &out);
+  void cpp_generate(Code_Sink &out);
+  int32_t vm_compile(VM_Builder &b);
+  void runtime_refs(Runtime_Refs &refs);
 };
 
 /////////////// Declaration //////////////////
 class Decl_Expr : public Expression {
 public:
   Decl_Expr(YYLTYPE loc) : Expression(loc) {}
-  virtual Symbol *type_check() = 0;
-  virtual std::string code_generate() = 0;
+  virtual Symbol *type_check(Env *env) = 0;
+  virtual void code_generate(Code_Sink &out) = 0;
+  virtual void cpp_generate(Code_Sink &out) = 0;
+  virtual int32_t vm_compile(VM_Builder &b) = 0;
+  virtual void runtime_refs(Runtime_Refs &refs) = 0;
 };
 
 class Var_Decl_Expr : public Decl_Expr {
@@ -126,8 +222,12 @@ public:
     this->identifier = id;
     this->init = init;
   }
-  Symbol *type_check();
-  std::string code_generate();
+  Symbol *type_check(Env *env);
+  Expression *fold();
+  void code_generate(Code_Sink &out);
+  void cpp_generate(Code_Sink &out);
+  int32_t vm_compile(VM_Builder &b);
+  void runtime_refs(Runtime_Refs &refs);
 };
 
 class Property_Decl_Expr : public Decl_Expr {
@@ -139,8 +239,11 @@ public:
     this->owner_id = owner_id;
     this->property_name = property_id;
   }
-  Symbol *type_check();
-  std::string code_generate();
+  Symbol *type_check(Env *env);
+  void code_generate(Code_Sink &out);
+  void cpp_generate(Code_Sink &out);
+  int32_t vm_compile(VM_Builder &b);
+  void runtime_refs(Runtime_Refs &refs);
 };
 
 /////////////// Assignment //////////////////
@@ -152,8 +255,12 @@ public:
     this->id = id;
     this->expr = expr;
   }
-  Symbol *type_check();
-  std::string code_generate();
+  Symbol *type_check(Env *env);
+  Expression *fold();
+  void code_generate(Code_Sink &out);
+  void cpp_generate(Code_Sink &out);
+  int32_t vm_compile(VM_Builder &b);
+  void runtime_refs(Runtime_Refs &refs);
 };
 
 /////////////// Type-casting //////////////////
@@ -168,8 +275,11 @@ public:
     this->to_type = type;
     this->return_id = return_id;
   }
-  Symbol *type_check();
-  std::string code_generate();
+  Symbol *type_check(Env *env);
+  void code_generate(Code_Sink &out);
+  void cpp_generate(Code_Sink &out);
+  int32_t vm_compile(VM_Builder &b);
+  void runtime_refs(Runtime_Refs &refs);
 };
 
 /////////////// Function Call //////////////////
@@ -177,18 +287,21 @@ class Call_Expr : public Expression {
 public:
   Call_Expr(YYLTYPE loc) : Expression(loc) {}
   virtual bool is_cond_call() = 0;
-  virtual Symbol *type_check() = 0;
-  virtual std::string code_generate() = 0;
+  virtual Symbol *type_check(Env *env) = 0;
+  virtual void code_generate(Code_Sink &out) = 0;
+  virtual void cpp_generate(Code_Sink &out) = 0;
+  virtual int32_t vm_compile(VM_Builder &b) = 0;
+  virtual void runtime_refs(Runtime_Refs &refs) = 0;
 };
 
 class Direct_Call_Expr : public Call_Expr {
 public:
   Identifier *id;
   Symbol *func_name;
-  std::vector<Expression *> *arg_list;
+  Expression_List *arg_list;
   Identifier *return_id;
   Direct_Call_Expr(Identifier *id, Symbol *func_name,
-                   std::vector<Expression *> *arg_list, Identifier *return_id,
+                   Expression_List *arg_list, Identifier *return_id,
                    YYLTYPE loc)
       : Call_Expr(loc) {
     this->id = id;
@@ -197,7 +310,7 @@ public:
     this->return_id = return_id;
   }
 
-  Direct_Call_Expr(Symbol *func_name, std::vector<Expression *> *arg_list,
+  Direct_Call_Expr(Symbol *func_name, Expression_List *arg_list,
                    Identifier *return_id, YYLTYPE loc)
       : Call_Expr(loc) {
     this->func_name = func_name;
@@ -208,8 +321,12 @@ public:
   // Symbol *get_return_name();
   bool is_cond_call() { return false; }
   // Infer default return_id
-  Symbol *type_check();
-  std::string code_generate();
+  Symbol *type_check(Env *env);
+  Expression *fold();
+  void code_generate(Code_Sink &out);
+  void cpp_generate(Code_Sink &out);
+  int32_t vm_compile(VM_Builder &b);
+  void runtime_refs(Runtime_Refs &refs);
 };
 
 class Cond_Call_Expr : public Call_Expr {
@@ -218,7 +335,7 @@ public:
   Direct_Call_Expr *call_expr;
 
   Cond_Call_Expr(Expression *pre, Identifier *id, Symbol *func_name,
-                 std::vector<Expression *> *arg_list, Identifier *return_id,
+                 Expression_List *arg_list, Identifier *return_id,
                  YYLTYPE loc)
       : Call_Expr(loc) {
     this->predictor = pre;
@@ -227,7 +344,7 @@ public:
   }
 
   Cond_Call_Expr(Expression *pre, Symbol *func_name,
-                 std::vector<Expression *> *arg_list, Identifier *return_id,
+                 Expression_List *arg_list, Identifier *return_id,
                  YYLTYPE loc)
       : Call_Expr(loc) {
     this->predictor = pre;
@@ -241,19 +358,84 @@ public:
   }
 
   bool is_cond_call() { return true; }
-  Symbol *type_check();
-  std::string code_generate();
+  Symbol *type_check(Env *env);
+  void code_generate(Code_Sink &out);
+  void cpp_generate(Code_Sink &out);
+  int32_t vm_compile(VM_Builder &b);
+  void runtime_refs(Runtime_Refs &refs);
+};
+
+/////////////// Fused chain call //////////////////
+// Built-ins called one after another on a string, each on the result of the
+// one before, as in `x do trim -> do to_lower -> do reverse`. Put in place
+// of their Direct_Call_Exprs by Program::fuse_chains(), so that only the
+// last result is stored in return_id.
+class Chain_Call_Expr : public Expression {
+public:
+  Expression *source; // the caller, or the constant of an anonymous one
+  Expression_List *steps; // the Direct_Call_Exprs, in calling order
+  Identifier *return_id;
+  Chain_Call_Expr(Expression *source, Expression_List *steps,
+                  Identifier *return_id, YYLTYPE loc)
+      : Expression(loc) {
+    this->source = source;
+    this->steps = steps;
+    this->return_id = return_id;
+  }
+  Symbol *type_check(Env *env);
+  void code_generate(Code_Sink &out);
+  void cpp_generate(Code_Sink &out);
+  int32_t vm_compile(VM_Builder &b);
+  void runtime_refs(Runtime_Refs &refs);
+};
+
+/////////////// Reused calls //////////////////
+// Keeps a copy of id in saved, for a Reused_Call_Expr after id changed.
+// Put after the call storing into id by Program::reuse_calls().
+class Save_Expr : public Expression {
+public:
+  Identifier *id;
+  Identifier *saved;
+  Save_Expr(Identifier *id, Identifier *saved, YYLTYPE loc)
+      : Expression(loc) {
+    this->id = id;
+    this->saved = saved;
+  }
+  Symbol *type_check(Env *env);
+  void code_generate(Code_Sink &out);
+  void cpp_generate(Code_Sink &out);
+  int32_t vm_compile(VM_Builder &b);
+  void runtime_refs(Runtime_Refs &refs);
+};
+
+// A call of a pure built-in on the same inputs as an earlier one, unchanged
+// since: the result of the earlier call, in saved, is stored instead of
+// making the call again. Put in place of the call by Program::reuse_calls().
+class Reused_Call_Expr : public Expression {
+public:
+  Direct_Call_Expr *call;
+  Identifier *saved;
+  Reused_Call_Expr(Direct_Call_Expr *call, Identifier *saved, YYLTYPE loc)
+      : Expression(loc) {
+    this->call = call;
+    this->saved = saved;
+  }
+  Symbol *type_check(Env *env);
+  void code_generate(Code_Sink &out);
+  void cpp_generate(Code_Sink &out);
+  int32_t vm_compile(VM_Builder &b);
+  void runtime_refs(Runtime_Refs &refs);
 };
 
 /////////////// Conditional //////////////////
 class Cond_Expr : public Expression {
 public:
   Expression *predictor;
-  std::vector<Expression *> *_then_list;
-  std::vector<Expression *> *_else_list;
+  Expression_List *_then_list;
+  Expression_List *_else_list;
   bool has_else;
-  Cond_Expr(Expression *predictor, std::vector<Expression *> *_then_list,
-            std::vector<Expression *> *_else_list, YYLTYPE loc)
+  Cond_Expr(Expression *predictor, Expression_List *_then_list,
+            Expression_List *_else_list, YYLTYPE loc)
       : Expression(loc) {
     this->predictor = predictor;
     this->_then_list = _then_list;
@@ -261,16 +443,20 @@ public:
     this->has_else = true;
   }
 
-  Cond_Expr(Expression *predictor, std::vector<Expression *> *_then_list,
+  Cond_Expr(Expression *predictor, Expression_List *_then_list,
             YYLTYPE loc)
       : Expression(loc) {
     this->predictor = predictor;
     this->_then_list = _then_list;
-    this->_else_list = new std::vector<Expression *>;
+    this->_else_list = new_expr_list();
     this->has_else = false;
   }
-  Symbol *type_check();
-  std::string code_generate();
+  Symbol *type_check(Env *env);
+  Expression *fold();
+  void code_generate(Code_Sink &out);
+  void cpp_generate(Code_Sink &out);
+  int32_t vm_compile(VM_Builder &b);
+  void runtime_refs(Runtime_Refs &refs);
 };
 
 /////////////// Comparion //////////////////
@@ -285,8 +471,12 @@ public:
     this->op = op;
     this->e2 = e2;
   }
-  Symbol *type_check();
-  std::string code_generate();
+  Symbol *type_check(Env *env);
+  Expression *fold();
+  void code_generate(Code_Sink &out);
+  void cpp_generate(Code_Sink &out);
+  int32_t vm_compile(VM_Builder &b);
+  void runtime_refs(Runtime_Refs &refs);
 };
 
 /////////////// Arithmetic //////////////////
@@ -301,8 +491,12 @@ public:
     this->op = op;
     this->e2 = e2;
   }
-  Symbol *type_check();
-  std::string code_generate();
+  Symbol *type_check(Env *env);
+  Expression *fold();
+  void code_generate(Code_Sink &out);
+  void cpp_generate(Code_Sink &out);
+  int32_t vm_compile(VM_Builder &b);
+  void runtime_refs(Runtime_Refs &refs);
 };
 
 /////////////// Constant //////////////////
@@ -317,8 +511,11 @@ public:
   String_Const_Expr(Symbol *token, YYLTYPE loc) : Const_Expr(loc) {
     this->token = token;
   }
-  Symbol *type_check();
-  std::string code_generate();
+  Symbol *type_check(Env *env);
+  void code_generate(Code_Sink &out);
+  void cpp_generate(Code_Sink &out);
+  int32_t vm_compile(VM_Builder &b);
+  void runtime_refs(Runtime_Refs &refs);
 };
 
 class Int_Const_Expr : public Const_Expr {
@@ -327,8 +524,11 @@ public:
   Int_Const_Expr(Symbol *token, YYLTYPE loc) : Const_Expr(loc) {
     this->token = token;
   }
-  Symbol *type_check();
-  std::string code_generate();
+  Symbol *type_check(Env *env);
+  void code_generate(Code_Sink &out);
+  void cpp_generate(Code_Sink &out);
+  int32_t vm_compile(VM_Builder &b);
+  void runtime_refs(Runtime_Refs &refs);
 };
 
 class Bool_Const_Expr : public Const_Expr {
@@ -337,8 +537,11 @@ public:
   Bool_Const_Expr(bool value, YYLTYPE loc) : Const_Expr(loc) {
     this->value = value;
   }
-  Symbol *type_check();
-  std::string code_generate();
+  Symbol *type_check(Env *env);
+  void code_generate(Code_Sink &out);
+  void cpp_generate(Code_Sink &out);
+  int32_t vm_compile(VM_Builder &b);
+  void runtime_refs(Runtime_Refs &refs);
 };
 
 #endif
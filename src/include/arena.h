@@ -0,0 +1,98 @@
+/*
+  Saytring Compiler. A compiler translating Saytring to Python.
+  Copyright (C) 2024 Haoyuan Li
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include <cstddef>
+#include <new>
+
+#define ARENA_CHUNK_SIZE (64 * 1024)
+
+// Bump-pointer allocator. Memory is carved from large chunks and only
+// released all at once, by release() or when the Arena is destroyed.
+// Destructors of objects living in an Arena are never run.
+class Arena {
+private:
+  struct Chunk {
+    Chunk *next;
+    size_t size; // usable bytes following the header
+  };
+
+  Chunk *head;
+  char *cur;
+  char *end;
+  size_t chunk_size;
+  size_t used_bytes;
+  size_t reserved_bytes;
+
+  void *allocate_slow(size_t size, size_t align);
+
+public:
+  Arena(size_t chunk_size = ARENA_CHUNK_SIZE);
+  ~Arena() { release(); }
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+
+  void *allocate(size_t size, size_t align = alignof(std::max_align_t)) {
+    char *p = (char *)(((size_t)cur + align - 1) & ~(align - 1));
+    if (p + size > end)
+      return allocate_slow(size, align);
+    cur = p + size;
+    used_bytes += size;
+    return p;
+  }
+
+  // Copy len bytes of s into the Arena, with a trailing '\0'
+  char *copy_string(const char *s, size_t len);
+
+  // Free every chunk at once
+  void release();
+
+  size_t bytes_used() const { return used_bytes; }
+  size_t bytes_reserved() const { return reserved_bytes; }
+};
+
+inline void *operator new(size_t size, Arena &arena) {
+  return arena.allocate(size);
+}
+inline void operator delete(void *, Arena &) {}
+
+// STL allocator drawing from an Arena; deallocate() is a no-op
+template <class T> class Arena_Allocator {
+public:
+  typedef T value_type;
+  Arena *arena;
+
+  Arena_Allocator(Arena *arena) : arena(arena) {}
+  template <class U>
+  Arena_Allocator(const Arena_Allocator<U> &other) : arena(other.arena) {}
+
+  T *allocate(size_t n) {
+    return static_cast<T *>(arena->allocate(n * sizeof(T), alignof(T)));
+  }
+  void deallocate(T *, size_t) {}
+
+  template <class U> bool operator==(const Arena_Allocator<U> &other) const {
+    return arena == other.arena;
+  }
+  template <class U> bool operator!=(const Arena_Allocator<U> &other) const {
+    return arena != other.arena;
+  }
+};
+
+#endif
@@ -0,0 +1,79 @@
+/*
+  Saytring Compiler. A compiler translating Saytring to Python.
+  Copyright (C) 2024 Haoyuan Li
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef _BATCH_H_
+#define _BATCH_H_
+
+#include "cache.h"
+#include "runtime.h"
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// One input of a batch and everything its compilation reported
+struct Batch_Job {
+  std::string input_filename;
+  std::string output_filename;
+  std::string log; // diagnostics and status lines of this input only
+  bool success;
+};
+
+// Compiles many inputs in one process. The symbol tables, built-in tables,
+// code templates and runtime are set up once and shared read-only; each
+// input gets its own Compile_Context. Workers take the next unstarted job
+// from a shared counter, so a slow input never holds up the others, while
+// the logs are still printed in input order as soon as they are complete.
+class Batch_Compiler {
+private:
+  std::vector<Batch_Job> jobs;
+  Runtime runtime; // what each output uses of it goes in front
+  Compile_Cache *cache; // nullptr if disabled
+  std::string cache_salt;
+
+  std::atomic<size_t> next_job; // the next job to be taken by a worker
+  std::mutex print_lock;        // guards finished and next_to_print
+  std::vector<char> finished;
+  size_t next_to_print;
+
+  void add_job(const std::string &input_filename,
+               const std::string &output_dir);
+  void compile(Batch_Job &job);
+  void finish(size_t index);
+  void worker();
+
+public:
+  Batch_Compiler() : cache(nullptr), next_job(0), next_to_print(0) {}
+
+  // Add every .say file in the directory path, or if path is a regular
+  // file, every input named in it (one per line). Outputs are written to
+  // output_dir, or next to their inputs if output_dir is empty. Fail if
+  // two inputs would be compiled to the same output.
+  bool add_inputs(const std::string &path, const std::string &output_dir);
+  bool load_runtime(const char *runtime_filename, Runtime_Mode mode);
+  void use_cache(Compile_Cache *cache, const std::string &salt) {
+    this->cache = cache;
+    this->cache_salt = salt;
+  }
+
+  // Compile every job on thread_count threads (0 for one per core).
+  // Return the number of inputs that failed to compile.
+  int run(unsigned thread_count);
+  size_t size() const { return jobs.size(); }
+};
+
+#endif
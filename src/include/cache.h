@@ -0,0 +1,69 @@
+/*
+  Saytring Compiler. A compiler translating Saytring to Python.
+  Copyright (C) 2024 Haoyuan Li
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef _CACHE_H_
+#define _CACHE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <iostream>
+#include <string>
+
+// A content-addressed cache of compiled programs in a local directory.
+// An entry is keyed by a 128-bit hash of everything the output depends
+// on and made of two files: <key>.py, the complete output, and
+// <key>.log, whatever the compilation reported. Both are filled through
+// a temporary file and rename(), .log first, so readers (other threads or
+// other saytringc processes) never see a partial entry.
+class Compile_Cache {
+private:
+  std::string dir;
+  std::atomic<unsigned> hits;
+  std::atomic<unsigned> misses;
+  std::atomic<unsigned> stores;
+  std::atomic<unsigned> failures; // entries that could not be written
+
+  std::string entry_path(const std::string &key, const char *ext) const;
+  bool write_atomically(const std::string &path, const std::string &data);
+
+public:
+  Compile_Cache(const std::string &dir)
+      : dir(dir), hits(0), misses(0), stores(0), failures(0) {}
+
+  // Create the cache directory if needed
+  bool open();
+
+  // Hash the compiler version and the options affecting the output
+  // (salt), the input file name (it appears in diagnostics), the runtime
+  // and the source
+  static std::string key(const std::string &salt,
+                         const std::string &input_filename,
+                         const std::string &runtime, const char *source,
+                         size_t size);
+
+  // On a hit, copy the cached output to output_filename, set log to the
+  // cached log and return true
+  bool fetch(const std::string &key, const std::string &output_filename,
+             std::string &log);
+  // Add the output held in output_filename to the cache
+  void store(const std::string &key, const std::string &output_filename,
+             const std::string &log);
+
+  void report(std::ostream &out) const;
+};
+
+#endif
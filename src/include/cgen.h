@@ -19,60 +19,79 @@
 #define _CGEN_H_
 
 #include "AST.h"
+#include "sink.h"
+#include "symtab.h"
 #include "template.h"
+#include <iterator>
 #include <string>
-#include <unordered_map>
+#include <string_view>
+#include <tuple>
+#include <utility>
 
-class Code_Generator {
-private:
-  std::unordered_map<std::string, std::string> templates;
-
-public:
-  // Initialize code templates
-  // #define TEMPLATE_COMMENT "# {content}\n"
-  // #define TEMPLATE_STRING_CONST "\"{value}\""
-  // #define TEMPLATE_INTNBOOL_CONST "{value}"
-  // #define TEMPLATE_VAR "# {id}"
-  // #define TEMPLATE_PROPERTY "# {owner}_{prop}"
-  // #define TEMPLATE_TYPE "DataType.{type}"
-  // #define TEMPLATE_FUNC_CALL "{name}({params})\n"
-  // #define TEMPLATE_INLINE_FUNC_CALL "{name}({params})"
-  // #define TEMPLATE_VAR_DECL "{name} = Saytring({init}, {type})\n"
-  // #define TEMPLATE_PROP_DECL "{owner}_{name} = Saytring()\n"
-  // #define TEMPLATE_ASSIGN "{id} = {expr}\n"
-  // #define TEMPLATE_IF_STATEMENT "if {condition}:\n    {_then}\n"
-  // #define TEMPLATE_IF_ELSE_STATEMENT \
-  //   "if {condition}:\n    {_then}\nelse:\n    {_else}\n"
-  Code_Generator() {
-    templates["comment"] = TEMPLATE_COMMENT;
-    templates["string"] = TEMPLATE_STRING_CONST;
-    templates["intnbool"] = TEMPLATE_INTNBOOL_CONST;
-    templates["var"] = TEMPLATE_VAR;
-    templates["property"] = TEMPLATE_PROPERTY;
-    templates["type"] = TEMPLATE_TYPE;
-    templates["func_call"] = TEMPLATE_FUNC_CALL;
-    templates["inline_func_call"] = TEMPLATE_INLINE_FUNC_CALL;
-    templates["var_decl"] = TEMPLATE_VAR_DECL;
-    templates["prop_decl"] = TEMPLATE_PROP_DECL;
-    templates["assign"] = TEMPLATE_ASSIGN;
-    templates["if_statement"] = TEMPLATE_IF_STATEMENT;
-    templates["if_else_statement"] = TEMPLATE_IF_ELSE_STATEMENT;
-  }
+// Appends the code of an expression, as an argument of emit()
+struct Code_Of {
+  Expression *expr;
+  void operator()(Code_Sink &out) const { expr->code_generate(out); }
+};
 
-  // Generate code according to template
-  std::string
-  generate(const std::string &template_name,
-           const std::unordered_map<std::string, std::string> &params) {
-    std::string code = templates[template_name];
-    for (const auto &[key, value] : params) {
-      size_t pos = code.find("{" + key + "}");
-      while (pos != std::string::npos) {
-        code.replace(pos, key.length() + 2, value);
-        pos = code.find("{" + key + "}", pos + value.length());
-      }
-    }
-    return code;
-  }
+// Appends the C++ code of an expression, as an argument of emit()
+struct Cpp_Of {
+  Expression *expr;
+  void operator()(Code_Sink &out) const { expr->cpp_generate(out); }
 };
 
+// The value of a string constant, whose escapes the lexer left in Python's
+// syntax, in UTF-8
+std::string python_string_value(std::string_view text);
+
+// say() prints anything but a variable as it is
+bool is_plain_say(Direct_Call_Expr *call);
+// The caller, the args and the return_id of call, separated by commas, each
+// appended by generate
+void generate_params(Code_Sink &out, Direct_Call_Expr *call,
+                     void (Expression::*generate)(Code_Sink &) =
+                         &Expression::code_generate);
+
+// An argument of emit() is either text, a Symbol, or a callable appending
+// its code to out
+inline void emit_arg(Code_Sink &out, std::string_view text) {
+  out.append(text.data(), text.size());
+}
+inline void emit_arg(Code_Sink &out, const char *text) { out.append(text); }
+inline void emit_arg(Code_Sink &out, Symbol *sym) {
+  out.append(sym->get_string(), sym->get_len());
+}
+template <class F>
+inline auto emit_arg(Code_Sink &out, const F &f) -> decltype(f(out)) {
+  f(out);
+}
+
+template <const auto &T, size_t I, class Args>
+inline void emit_segment(Code_Sink &out, const Args &args) {
+  constexpr Template_Segment seg = T.segments[I];
+  if constexpr (seg.slot == TEMPLATE_NEWLINE)
+    out.newline();
+  else if constexpr (seg.slot == TEMPLATE_TEXT)
+    out.append(seg.text.data(), seg.text.size());
+  else
+    emit_arg(out, std::get<seg.slot>(args));
+}
+
+template <const auto &T, class Args, size_t... I>
+inline void emit_segments(Code_Sink &out, const Args &args,
+                          std::index_sequence<I...>) {
+  (emit_segment<T, I>(out, args), ...);
+}
+
+// Append template T to out, with args filling its slots in order. The
+// template is unrolled at compile time, so this is a plain sequence of
+// appends and line breaks.
+template <const auto &T, class... Args>
+inline void emit(Code_Sink &out, const Args &...args) {
+  static_assert(T.slot_count == sizeof...(Args),
+                "wrong number of arguments for code template");
+  emit_segments<T>(out, std::forward_as_tuple(args...),
+                   std::make_index_sequence<std::size(T.segments)>());
+}
+
 #endif
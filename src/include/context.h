@@ -0,0 +1,95 @@
+/*
+  Saytring Compiler. A compiler translating Saytring to Python.
+  Copyright (C) 2024 Haoyuan Li
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef _CONTEXT_H_
+#define _CONTEXT_H_
+
+#include "AST.h"
+#include "arena.h"
+#include "runtime.h"
+#include "semant.h"
+#include "sink.h"
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Everything one compilation (translation unit) owns: the AST and its
+// Arena, the parser's and lexer's working state, the type environment and
+// the error counters. Nothing in here is shared, so separate
+// Compile_Contexts can be worked on by separate threads at the same time.
+class Compile_Context {
+public:
+  std::string input_filename;
+  std::ostream *diag; // where errors and warnings go
+
+  Arena arena;                       // owns the AST
+  Program *ast_root;                 // the result of the parse
+  std::vector<AST_Node *> *node_log; // if set, records every AST node
+
+  // Parser state
+  // TODO: Can use stack to manage `has_pushed_back`
+  bool has_pushed_back;
+  Expression_List *global_expr_list;
+  Expression_List *temp_expr_list;
+  std::vector<Symbol *> temp_identifier_list;
+  std::vector<Call_Expr *> temp_call_list;
+  Identifier *temp_return_id;
+
+  // Lexer state
+  std::string string_buf; // to assemble string constants
+  int last_token;         // the lookahead, for syntax error messages
+  YYSTYPE last_lval;
+
+  int syntax_error_count;
+  int syntax_warn_count;
+
+  Env env; // holds the semant error counters
+
+  // If set, the symbols only this compilation uses, freed with it, see
+  // own_symbols()
+  std::unique_ptr<String_Tab> own_id_tab, own_str_tab, own_int_tab;
+
+  Compile_Context(const std::string &input_filename,
+                  std::ostream *diag = &std::cerr);
+  ~Compile_Context();
+
+  // Intern the identifiers and constants the shared tables do not hold yet
+  // into tables of this compilation's own, so that a process compiling
+  // inputs for ever does not keep all of them
+  void own_symbols();
+
+  // Parse the input held in base, which must be followed by
+  // SOURCE_SENTINELS '\0'. Return the result of yyparse().
+  int parse(char *base, size_t size);
+  void semant_check();
+  void fold_constants();
+  void fuse_chains();
+  void reuse_calls();
+  void hoist_setup();
+  // Parse, check and optimize the input. Diagnostics and status lines,
+  // prefixed with the input file name, go to diag. On failure the AST is
+  // released and false returned.
+  bool check(char *base, size_t size);
+  // Generate the code of the checked input, preceded by the part of
+  // runtime it uses, into out, then release the AST
+  void generate(Code_Sink &out, const Runtime &runtime);
+  // Release the AST
+  void release();
+};
+
+#endif
@@ -22,8 +22,10 @@
 #include <map>
 #include <string>
 
+class Env;
+
 void install_buildin_func();
-void install_buildin_var();
+void install_buildin_var(Env *env);
 void install_type_cast_map();
 
 #endif
@@ -38,6 +38,60 @@ const std::vector<Flag> flags = {
     {"--debug", 'd', "Enable debug mode for detailed logs", false, "false"},
     {"--run", 'r', "Run the program automatically after compilation", false,
      "false"},
+    {"--run-python", '\0',
+     "Run the output with python for --run, instead of the built-in VM",
+     false, "false"},
+    {"--batch", 'b',
+     "Compile every .say file in a directory, or every file listed in a "
+     "file, into the --output directory",
+     true, "<None>"},
+    {"--jobs", 'j',
+     "Number of threads for --batch and for independent --records, 0 for "
+     "one per core",
+     true, "0"},
+    {"--cache", 'c',
+     "Look compiled programs up in, and add them to, the cache in the given "
+     "directory",
+     true, "<None>"},
+    {"--serve", 's',
+     "Serve compile requests on a Unix socket at the given path, keeping "
+     "the built-in tables and runtime loaded",
+     true, "<None>"},
+    {"--time-report", '\0', "Report the time spent in each compilation phase",
+     false, "false"},
+    {"--mem-report", '\0',
+     "Report the memory held by the AST, the tables and the generated code",
+     false, "false"},
+    {"--full-runtime", '\0',
+     "Copy the whole runtime into the output, not only what the program "
+     "uses",
+     false, "false"},
+    {"--runtime-module", '\0',
+     "Import the runtime from the package installed by --install-runtime, "
+     "instead of copying it into the output",
+     false, "false"},
+    {"--install-runtime", '\0',
+     "Install the runtime as the saytring_runtime package into the given "
+     "directory, for --runtime-module",
+     true, "<None>"},
+    {"--report-format", '\0', "Format of the reports: text or json", true,
+     "text"},
+    {"--target", '\0',
+     "Language to compile to: python, or cpp for C++ built into a native "
+     "binary with $CXX (output.cc and ../runtime/runtime.h by default)",
+     true, "python"},
+    {"--precompile", '\0',
+     "Also write the checked program to the given file as bytecode, to be "
+     "run by --exec without compiling it again",
+     true, "<None>"},
+    {"--exec", 'x',
+     "Run a program precompiled by --precompile and exit, without lexing, "
+     "parsing or checking it",
+     true, "<None>"},
+    {"--records", '\0',
+     "Run the program once per line of the given file, - for stdin, with "
+     "the line in the string variable record",
+     true, "<None>"},
     {"--help", 'h', "Display this help message and exit", false, "false"},
     {"--version", 'v', "Display the version information and exit", false,
      "false"}};
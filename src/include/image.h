@@ -0,0 +1,99 @@
+/*
+  Saytring Compiler. A compiler translating Saytring to Python.
+  Copyright (C) 2024 Haoyuan Li
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef _IMAGE_H_
+#define _IMAGE_H_
+
+#include "vm.h"
+#include <cstddef>
+#include <cstdint>
+
+#define VM_IMAGE_MAGIC "SAYC"
+// Bumped whenever the layout or the bytecode changes
+#define VM_IMAGE_FORMAT 4
+#define VM_IMAGE_BYTE_ORDER 0x01020304u
+
+// A precompiled program, written by --precompile and run by --exec: the
+// VM_Program of a checked program, mapped and run without the front end.
+// The sections follow the header, 8-byte aligned, and are found by their
+// offsets from the start of the file, so that it runs wherever it is
+// mapped:
+//   code       the instructions, int32_t words
+//   constants  VM_Image_Constants
+//   slots      a VM_Image_String for the name of each slot
+//   pool       the bytes of the strings: the str_tab constants the program
+//              uses and the slot names, each once
+// Numbers are in the byte order of the machine that wrote it.
+struct VM_Image_String {
+  uint32_t offset; // in the pool
+  uint32_t length;
+};
+
+struct VM_Image_Constant {
+  int32_t reg;
+  int32_t kind; // a VM_Constant::Kind
+  int64_t i;
+  VM_Image_String s;
+};
+
+struct VM_Image_Header {
+  char magic[4];       // VM_IMAGE_MAGIC
+  uint32_t format;     // VM_IMAGE_FORMAT
+  uint32_t byte_order; // VM_IMAGE_BYTE_ORDER as written
+  uint32_t size;       // of the whole file
+  char compiler[16];   // _VERSION_ of the compiler that wrote it
+  uint32_t code_offset, code_length;
+  uint32_t constants_offset, constant_count;
+  uint32_t slots_offset, slot_count;
+  uint32_t pool_offset, pool_size;
+  uint32_t register_count;
+  int32_t record_slot; // of VM_Layout
+  uint32_t body;
+  uint32_t independent; // 0 or 1
+};
+
+// A precompiled program mapped read-only. open() checks the header, the
+// sections and every instruction, so that a damaged or foreign file is
+// refused rather than run.
+class VM_Image {
+private:
+  const char *base;
+  size_t size;
+
+  const VM_Image_Header *header() const {
+    return (const VM_Image_Header *)base;
+  }
+  bool check(const char *filename) const;
+
+public:
+  VM_Image() : base(nullptr), size(0) {}
+  ~VM_Image() { close(); }
+  VM_Image(const VM_Image &) = delete;
+  VM_Image &operator=(const VM_Image &) = delete;
+
+  // Write program to filename, through a temporary file and rename(), so
+  // that a program being run is never seen half written
+  static bool write(const VM_Program &program, const char *filename);
+
+  bool open(const char *filename);
+  void close();
+  bool record_mode() const { return header()->record_slot >= 0; }
+  // Run the program, see vm_run()
+  int run(int records = 0, unsigned jobs = 1) const;
+};
+
+#endif
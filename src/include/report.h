@@ -0,0 +1,80 @@
+/*
+  Saytring Compiler. A compiler translating Saytring to Python.
+  Copyright (C) 2024 Haoyuan Li
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef _REPORT_H_
+#define _REPORT_H_
+
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <vector>
+
+class AST_Node;
+
+// Wall time spent in each phase of a compilation, for --time-report.
+// Phases are timed back to back: lap() ends the running phase and starts
+// the next one, so together they cover the whole compilation. The peak
+// RSS of the process is sampled at the end of every phase as well.
+class Time_Report {
+private:
+  typedef std::chrono::steady_clock clock;
+  struct Phase {
+    std::string name;
+    double seconds;
+    long peak_rss; // bytes, at the end of the phase
+  };
+  std::vector<Phase> phases;
+  clock::time_point phase_start;
+
+public:
+  Time_Report() : phase_start(clock::now()) {}
+
+  // End the running phase, which is then reported as name
+  void lap(const char *name);
+  double total() const;
+  // Print as a table, or as a single line of JSON
+  void print(std::ostream &out, bool json) const;
+};
+
+// Peak resident set size of the process so far, in bytes
+long peak_rss();
+
+// Where the memory of a compilation goes, for --mem-report. Entries are
+// grouped in sections in the order they were added; a count or size the
+// report cannot know is left out.
+class Mem_Report {
+private:
+  struct Entry {
+    std::string section;
+    std::string name;
+    long count; // -1 if not applicable
+    long bytes; // -1 if not applicable
+  };
+  std::vector<Entry> entries;
+
+public:
+  void add(const std::string &section, const std::string &name, long count,
+           long bytes = -1);
+  // Count AST nodes by class
+  void add_ast_nodes(const std::vector<AST_Node *> &nodes);
+  // Peak resident set size of the process so far
+  void add_peak_rss();
+  void print(std::ostream &out, bool json) const;
+};
+
+#endif
@@ -0,0 +1,125 @@
+/*
+  Saytring Compiler. A compiler translating Saytring to Python.
+  Copyright (C) 2024 Haoyuan Li
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef _RUNTIME_H_
+#define _RUNTIME_H_
+
+#include "symtab.h"
+#include <functional>
+#include <map>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class Code_Sink;
+class Runtime_Refs;
+
+// How the runtime gets into the output
+enum Runtime_Mode {
+  RUNTIME_USED,   // the definitions the program uses
+  RUNTIME_FULL,   // all of it, for --full-runtime
+  RUNTIME_MODULE, // imported from saytring_runtime, for --runtime-module
+};
+
+// The language the program is compiled to
+enum Target {
+  TARGET_PYTHON, // a script with the runtime.py it uses in front
+  TARGET_CPP,    // C++ with all of runtime.h in front, for --target cpp
+};
+
+// The package --install-runtime creates and --runtime-module imports
+#define RUNTIME_MODULE_NAME "saytring_runtime"
+
+// runtime.py, split into its top-level definitions: a def, a class or an
+// assignment, along with the comments right above it. A program only gets
+// the definitions it refers to and the ones they need in turn; everything
+// defining no name (the docstring, imports) is always kept. References
+// between definitions are found by name, anywhere in their text, so a
+// definition may be kept without need but is never dropped while needed.
+//
+// Instead, the runtime can be installed once as a package, which programs
+// import the names they use from. The package records the compiler version
+// and a hash of the runtime, which programs check when importing it.
+//
+// For TARGET_CPP the runtime is runtime.h, which is never split: the C++
+// compiler drops what the program does not use.
+class Runtime {
+private:
+  struct Definition {
+    size_t begin, end;        // the text of the definition
+    std::vector<size_t> uses; // definitions it refers to
+    std::string_view name;    // empty if it defines no name, always kept
+  };
+  std::string text;
+  std::vector<Definition> definitions;
+  std::map<std::string, size_t, std::less<>> names; // name -> definition
+  Runtime_Mode mode;
+  Target target;
+
+  void split();
+  void write_import(Code_Sink &out, const Runtime_Refs &refs) const;
+
+public:
+  Runtime() : mode(RUNTIME_USED), target(TARGET_PYTHON) {}
+  // Read and split the runtime file, reporting a missing file
+  bool load(const char *runtime_filename);
+  void set_mode(Runtime_Mode mode) { this->mode = mode; }
+  // Set before load()
+  void set_target(Target target) { this->target = target; }
+  Target get_target() const { return target; }
+  const std::string &source() const { return text; }
+  size_t size() const { return definitions.size(); }
+  // The definition of name, or size() if the runtime does not define it
+  size_t find(std::string_view name) const;
+  // Append to out what the program using refs needs of the runtime: the
+  // definitions it uses in their original order, all of them, or the
+  // import of the names it uses from the package
+  void write(Code_Sink &out, const Runtime_Refs &refs) const;
+
+  // The version of the package: the compiler version and the runtime hash
+  std::string version() const;
+  // Write the runtime as the package RUNTIME_MODULE_NAME into the
+  // directory dir, reporting any failure
+  bool install(const std::string &dir) const;
+};
+
+// The runtime definitions a program refers to, collected by
+// runtime_refs() on its AST. For TARGET_CPP, the variables it refers to as
+// well, which the C++ code has to define up front.
+class Runtime_Refs {
+private:
+  const Runtime &runtime;
+  std::vector<char> used;          // by definition
+  std::set<std::string> variables; // by generated name, TARGET_CPP only
+
+public:
+  explicit Runtime_Refs(const Runtime &runtime)
+      : runtime(runtime), used(runtime.size(), 0) {}
+  // Names the runtime does not define are ignored
+  void add(std::string_view name);
+  void add(Symbol *sym) { add({sym->get_string(), sym->get_len()}); }
+  // The variable generated for the property name of owner
+  void add(Symbol *owner, Symbol *name);
+  // A variable of the program, or the property name of owner
+  void add_variable(Symbol *name);
+  void add_variable(Symbol *owner, Symbol *name);
+  bool uses(size_t definition) const { return used[definition]; }
+  const std::set<std::string> &get_variables() const { return variables; }
+};
+
+#endif
@@ -24,24 +24,41 @@
 #include <utility>
 #include <vector>
 
-// Print error information during semant check
-std::ostream &semant_error(AST_Node *node);
+typedef std::map<Symbol *, std::vector<Symbol *> *>
+    Func_Map; // <Func_Name, vector<argIdentifier_types>>
 
-std::ostream &semant_warn(AST_Node *node);
+// Built-in function signatures, installed once and shared read-only
+extern Func_Map *buildin_func_map;
 
+// Type environment of one compilation
 class Env {
 public:
-  static std::map<Symbol *, Symbol *> *id_map; // <Single_ID_name, Type>
-  static std::map<std::pair<Symbol *, Symbol *>, Symbol *>
-      *property_map; // <Owner_name, ID_name, Type>
-  static std::map<Symbol *, std::vector<Symbol *> *>
-      *func_map; // <Func_Name, vector<argIdentifier_types>>
-
-  static Symbol *get_id_type(Single_Identifier *id);
-  static Symbol *get_id_type(Owner_Identifier *id);
-  static void update_id_type_info(Identifier *id, Symbol *new_type);
-  static void update_id_type_info(Single_Identifier *id, Symbol *new_type);
-  static void update_id_type_info(Owner_Identifier *id, Symbol *new_type);
+  std::map<Symbol *, Symbol *> id_map; // <Single_ID_name, Type>
+  std::map<std::pair<Symbol *, Symbol *>, Symbol *>
+      property_map;       // <Owner_name, ID_name, Type>
+  const Func_Map *func_map; // <Func_Name, vector<argIdentifier_types>>
+
+  const char *filename; // for error messages
+  std::ostream *diag;   // where errors and warnings go
+  int error_count;
+  int warn_count;
+  // The program runs once per record, see Program::hoist_setup(): the
+  // string variable record is predefined
+  bool record_mode;
+  // The program is compiled to C++, see cgen_cpp.cc
+  bool cpp_target;
+
+  Env(const char *filename, std::ostream *diag);
+
+  // Print error information during semant check
+  std::ostream &semant_error(AST_Node *node);
+  std::ostream &semant_warn(AST_Node *node);
+
+  Symbol *get_id_type(Single_Identifier *id);
+  Symbol *get_id_type(Owner_Identifier *id);
+  void update_id_type_info(Identifier *id, Symbol *new_type);
+  void update_id_type_info(Single_Identifier *id, Symbol *new_type);
+  void update_id_type_info(Owner_Identifier *id, Symbol *new_type);
 };
 
 #endif
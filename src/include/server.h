@@ -0,0 +1,63 @@
+/*
+  Saytring Compiler. A compiler translating Saytring to Python.
+  Copyright (C) 2024 Haoyuan Li
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef _SERVER_H_
+#define _SERVER_H_
+
+#include "runtime.h"
+#include <string>
+
+// The largest source a request may send, in bytes
+#define SERVER_MAX_SOURCE (64u << 20)
+
+// A compile server listening on a Unix domain socket. The shared symbol
+// tables, built-in tables, code templates and runtime stay loaded between
+// requests, so a request only costs lexing, parsing and generating its own
+// input. Every connection is served by its own thread and may send
+// any number of requests:
+//
+//   request:  "<name> <length>\n" followed by <length> bytes of source,
+//             where <name> (no spaces) is used in diagnostics
+//   response: "<ok|error> <diag length> <code length>\n" followed by the
+//             diagnostics and then the generated code, runtime included
+//
+// A request whose header cannot be read, or whose <length> is above
+// SERVER_MAX_SOURCE, gets an error response and the connection is closed.
+// The symbols of each request are its own and freed with it, see
+// Compile_Context::own_symbols().
+class Compile_Server {
+private:
+  std::string socket_path;
+  Runtime runtime; // what each program uses of it goes in front
+  int listen_fd;
+
+  void serve_connection(int fd);
+  bool handle_request(int fd, const std::string &header);
+
+public:
+  Compile_Server(const std::string &socket_path)
+      : socket_path(socket_path), listen_fd(-1) {}
+  ~Compile_Server();
+
+  bool load_runtime(const char *runtime_filename, Runtime_Mode mode);
+  // Bind the socket, replacing a stale one left at socket_path
+  bool listen();
+  // Accept connections until the process is killed
+  void serve();
+};
+
+#endif
@@ -0,0 +1,101 @@
+/*
+  Saytring Compiler. A compiler translating Saytring to Python.
+  Copyright (C) 2024 Haoyuan Li
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef _SINK_H_
+#define _SINK_H_
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+
+#define SINK_BUFFER_SIZE (64 * 1024)
+
+// Where generated code goes: a fixed buffer flushed to a file descriptor,
+// or appended to a string. Code is written as it is generated, so the
+// memory it takes does not depend on the size of the program.
+//
+// The sink also keeps the indentation depth. Indentation is written lazily
+// in front of the first text of each line, so nested code only has to
+// raise the depth around its body.
+class Code_Sink {
+private:
+  int fd;              // -1 when writing to str
+  std::string *str;
+  char *buffer;        // only for fd
+  size_t used;
+  size_t total;        // bytes written through the sink
+  bool failed;         // a write to fd failed
+  int depth;
+  bool line_start;
+
+  void write_indent();
+  void put(const char *s, size_t len) {
+    if (line_start) {
+      line_start = false;
+      write_indent();
+    }
+    total += len;
+    if (!buffer) {
+      str->append(s, len);
+      return;
+    }
+    if (len > SINK_BUFFER_SIZE - used) {
+      write_through(s, len);
+      return;
+    }
+    memcpy(buffer + used, s, len);
+    used += len;
+  }
+  void write_through(const char *s, size_t len);
+
+public:
+  explicit Code_Sink(int fd);
+  explicit Code_Sink(std::string &str);
+  ~Code_Sink();
+  Code_Sink(const Code_Sink &) = delete;
+  Code_Sink &operator=(const Code_Sink &) = delete;
+
+  void append(const char *s, size_t len) {
+    if (len > 0)
+      put(s, len);
+  }
+  void append(const char *s) { append(s, strlen(s)); }
+  Code_Sink &operator+=(const char *s) {
+    append(s);
+    return *this;
+  }
+  Code_Sink &operator+=(char c) {
+    put(&c, 1);
+    return *this;
+  }
+
+  // End the line. An empty line is still indented, like any other line.
+  void newline() {
+    put("\n", 1);
+    line_start = true;
+  }
+  void indent() { depth++; }
+  void dedent() { depth--; }
+
+  // Copy the rest of the file in_fd, e.g. the runtime
+  bool copy_from(int in_fd);
+  // Write out the buffer, return false if any write failed
+  bool flush();
+  size_t bytes() const { return total; }
+};
+
+#endif
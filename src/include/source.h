@@ -0,0 +1,52 @@
+/*
+  Saytring Compiler. A compiler translating Saytring to Python.
+  Copyright (C) 2024 Haoyuan Li
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef _SOURCE_H_
+#define _SOURCE_H_
+
+#include <cstddef>
+
+// Number of '\0' sentinels yy_scan_buffer() requires after the input
+#define SOURCE_SENTINELS 2
+
+// The whole input held in memory and followed by SOURCE_SENTINELS '\0'
+// bytes, so that the lexer can scan it in place. Regular files are mmap'd
+// (private and writable, as flex NUL-terminates yytext inside the buffer),
+// anything else such as stdin or a pipe is read into a heap buffer.
+class Source_File {
+private:
+  char *base;
+  size_t size;       // input bytes, excluding the sentinels
+  size_t mapped_len; // 0 if base is a heap buffer
+  bool open_mapped(int fd, size_t file_size);
+  bool open_stream(int fd);
+
+public:
+  Source_File() : base(nullptr), size(0), mapped_len(0) {}
+  ~Source_File() { close(); }
+  Source_File(const Source_File &) = delete;
+  Source_File &operator=(const Source_File &) = delete;
+
+  // Load filename, or stdin if filename is "<stdin>"
+  bool open(const char *filename);
+  void close();
+
+  char *data() const { return base; }
+  size_t length() const { return size; }
+};
+
+#endif
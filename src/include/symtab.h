@@ -18,38 +18,75 @@
 #ifndef _SYMTAB_H_
 #define _SYMTAB_H_
 
+#include "arena.h"
 #include <iostream>
+#include <mutex>
 #include <string.h>
 #include <vector>
 
+// FNV-1a hash over the first len bytes of s
+unsigned int hash_string(const char *s, size_t len);
+
 class Symbol {
 protected:
-  char *str; // the string
+  char *str;         // the string
+  size_t len;        // length of str without '\0'
+  unsigned int hash; // precomputed hash_string(str, len)
 public:
   Symbol(char *s);
-  bool operator==(Symbol other);
+  // Refer to str without copying it, str must outlive the Symbol
+  Symbol(char *str, size_t len, unsigned int hash);
+  bool operator==(const Symbol &other) const;
 
   // Return the str and len components of the Entry.
   char *get_string() const { return str; }
+  size_t get_len() const { return len; }
+  unsigned int get_hash() const { return hash; }
 };
 
-// Store identifiers, make sure identifiers with same name is unique
+// Store identifiers, make sure identifiers with same name is unique.
+// Symbols are interned in an open-addressing hash table (linear probing), so
+// a lookup hitting an existing Symbol neither allocates nor copies.
+// Symbols and their strings are carved from the table's own Arena.
+// The tables are shared by every compilation, add_string() is thread-safe.
+// A table over a shared one only holds what the shared one does not, and
+// frees it when destroyed; the shared one must not grow meanwhile.
 class String_Tab {
 private:
-  std::vector<Symbol *> *symtab;
+  std::mutex lock;
+  Arena arena;
+  Symbol **slots;  // capacity is always a power of 2
+  size_t capacity;
+  size_t count;
+  String_Tab *shared; // looked up first, if set
+
+  void grow();
+  Symbol *find(const char *s, size_t len, unsigned int hash, size_t &pos);
 
 public:
-  String_Tab() { this->symtab = new std::vector<Symbol *>; }
+  String_Tab(String_Tab *shared = nullptr);
+  ~String_Tab() { delete[] slots; }
+  String_Tab(const String_Tab &) = delete;
+  String_Tab &operator=(const String_Tab &) = delete;
   Symbol *add_string(char *s);
+  Symbol *add_string(const char *s, size_t len);
+  size_t size() const { return count; }
+  // Memory held by the table: its Symbols, their strings and the slots
+  size_t bytes() const {
+    return arena.bytes_reserved() + capacity * sizeof(Symbol *);
+  }
 };
 
-extern String_Tab *id_tab;
-extern String_Tab *str_tab;
-extern String_Tab *int_tab;
+// The tables the symbols of this thread's compilation go to: the shared
+// ones, unless its Compile_Context has its own
+extern thread_local String_Tab *id_tab;
+extern thread_local String_Tab *str_tab;
+extern thread_local String_Tab *int_tab;
+extern String_Tab shared_id_tab, shared_str_tab, shared_int_tab;
 
 // Predefined symbols & basic types in Saytring
 extern Symbol *_string, *_int, *_list, *_bool, *NULL_Type, *ERR_Type,
-    *LAST_RESULT;
+    *LAST_RESULT, *RECORD;
 
 extern Symbol *_ADD, *_SUB, *_GT, *_LT, *_GE, *_LE, *_EQ, *_NE;
 
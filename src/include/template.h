@@ -18,6 +18,9 @@
 #ifndef _TEMPLATE_H
 #define _TEMPLATE_H
 
+#include <cstddef>
+#include <string_view>
+
 #define INTEND "    "
 
 // Definition of Python code templates for code generation
@@ -36,7 +39,168 @@
 #define TEMPLATE_IF_ELSE_STATEMENT                                             \
   "if _bool_wrap({condition}):\n{_then}else:\n{_else}"
 
+// Heads a program importing the runtime, for --runtime-module
+#define TEMPLATE_RUNTIME_IMPORT                                                \
+  "import {module}\n\n"                                                        \
+  "if getattr({module}, \"__version__\", None) != \"{version}\":\n"            \
+  "    raise ImportError(\n"                                                   \
+  "        \"{module} is not the runtime this program was compiled \"\n"       \
+  "        \"against ({version}), reinstall it with saytringc \"\n"            \
+  "        \"--install-runtime\"\n"                                            \
+  "    )\n"                                                                    \
+  "from {module} import {names}\n\n"
+
+// Runs the statements after it once per line of the files named on the
+// command line, or of stdin, for record mode
+#define TEMPLATE_RECORD_LOOP                                                   \
+  "import fileinput\n\n"                                                       \
+  "for _record in fileinput.input():\n"                                        \
+  "    if _record.endswith(\"\\n\"):\n"                                        \
+  "        _record = _record[:-1]\n"                                           \
+  "    record = SaytringVar(_record, DataType.STRING)\n"                       \
+  "    record_last_result = SaytringVar()\n"
+
+#define TEMPLATE_PRINT "print({value})"
+#define TEMPLATE_SAVE "{saved} = {id}._copy()"
+
 #define COMP_FUNC_NAME "comp"
 #define ARITH_FUNC_NAME "arithmetic"
 
+// Definition of C++ code templates, for --target cpp. Variables are
+// prefixed so that no Saytring name can clash with C++ or the runtime.
+#define CPP_TEMPLATE_STRING_CONST "\"{value}\"_s"
+#define CPP_TEMPLATE_INT_CONST "Value({value}LL)"
+#define CPP_TEMPLATE_BOOL_CONST "Value({value})"
+#define CPP_TEMPLATE_VAR "v_{id}"
+#define CPP_TEMPLATE_PROPERTY "v_{owner}_{prop}"
+#define CPP_TEMPLATE_VAR_DEF "static SaytringVar v_{name};"
+#define CPP_TEMPLATE_FUNC_CALL "{name}({params});"
+#define CPP_TEMPLATE_OPERATION "{name}({e1}, {e2}, Op::{op})"
+#define CPP_TEMPLATE_VAR_DECL                                                  \
+  "v_{name} = SaytringVar({init}, DataType::{type});"
+#define CPP_TEMPLATE_PROP_DECL "v_{owner}_{name} = SaytringVar();"
+#define CPP_TEMPLATE_ASSIGN "{id}.set_value({expr});"
+#define CPP_TEMPLATE_IF_STATEMENT "if (bool_wrap({condition})) {{\n{_then}}}"
+#define CPP_TEMPLATE_IF_ELSE_STATEMENT                                         \
+  "if (bool_wrap({condition})) {{\n{_then}}} else {{\n{_else}}}"
+#define CPP_TEMPLATE_PRINT "print({value});"
+#define CPP_TEMPLATE_SAVE "{saved} = {id};"
+#define CPP_TEMPLATE_REUSE                                                     \
+  "if (reusable({{{inputs}}})) {id} = {saved}; else {call}"
+#define CPP_TEMPLATE_PROGRAM                                                   \
+  "static void program() {{\n{body}}}\n\n"                                      \
+  "int main() {{ return run(program); }}\n"
+
+// A template is parsed at compile time into runs of literal text, line
+// breaks and {slots}. Slots are numbered in the order their names first
+// appear, which is the order emit() takes their arguments in. "{{" and "}}"
+// stand for literal braces, as in Python's str.format().
+#define TEMPLATE_TEXT -1
+#define TEMPLATE_NEWLINE -2
+
+struct Template_Segment {
+  std::string_view text; // literal text, or the slot name
+  int slot; // TEMPLATE_TEXT, TEMPLATE_NEWLINE, or the argument index
+};
+
+template <size_t N> struct Code_Template {
+  Template_Segment segments[N];
+  int slot_count;
+};
+
+// Length of the segment starting at pos
+constexpr size_t template_segment_length(std::string_view text, size_t pos) {
+  if (text[pos] == '\n')
+    return 1;
+  if (text.substr(pos, 2) == "{{" || text.substr(pos, 2) == "}}")
+    return 2;
+  if (text[pos] == '{') {
+    size_t close = text.find('}', pos);
+    if (close == std::string_view::npos)
+      throw "unterminated slot in code template";
+    return close + 1 - pos;
+  }
+  size_t end = text.find_first_of("{}\n", pos + 1);
+  return (end == std::string_view::npos ? text.size() : end) - pos;
+}
+
+constexpr size_t count_template_segments(std::string_view text) {
+  size_t count = 0;
+  for (size_t pos = 0; pos < text.size();
+       pos += template_segment_length(text, pos))
+    count++;
+  return count;
+}
+
+template <size_t N>
+constexpr Code_Template<N> parse_template(std::string_view text) {
+  Code_Template<N> t{};
+  size_t pos = 0;
+  for (size_t i = 0; i < N; i++) {
+    Template_Segment &seg = t.segments[i];
+    size_t len = template_segment_length(text, pos);
+    if (text[pos] == '\n') {
+      seg = {text.substr(pos, 1), TEMPLATE_NEWLINE};
+    } else if (len == 2 && (text[pos] == '{' || text[pos] == '}') &&
+               text[pos + 1] == text[pos]) {
+      seg = {text.substr(pos, 1), TEMPLATE_TEXT};
+    } else if (text[pos] != '{') {
+      seg = {text.substr(pos, len), TEMPLATE_TEXT};
+    } else {
+      seg.text = text.substr(pos + 1, len - 2);
+      seg.slot = TEMPLATE_TEXT;
+      for (size_t j = 0; j < i; j++)
+        if (t.segments[j].slot >= 0 && t.segments[j].text == seg.text)
+          seg.slot = t.segments[j].slot;
+      if (seg.slot < 0)
+        seg.slot = t.slot_count++;
+    }
+    pos += len;
+  }
+  return t;
+}
+
+#define CODE_TEMPLATE(name, text)                                              \
+  inline constexpr auto name =                                                 \
+      parse_template<count_template_segments(text)>(text)
+
+// Arguments of emit(), in slot order
+CODE_TEMPLATE(string_template, TEMPLATE_STRING_CONST);     // value
+CODE_TEMPLATE(intnbool_template, TEMPLATE_INTNBOOL_CONST); // value
+CODE_TEMPLATE(var_template, TEMPLATE_VAR);                 // id
+CODE_TEMPLATE(property_template, TEMPLATE_PROPERTY);       // owner, prop
+CODE_TEMPLATE(func_call_template, TEMPLATE_FUNC_CALL);     // name, params
+CODE_TEMPLATE(var_decl_template, TEMPLATE_VAR_DECL);       // name, init, type
+CODE_TEMPLATE(prop_decl_template, TEMPLATE_PROP_DECL);     // owner, name
+CODE_TEMPLATE(assign_template, TEMPLATE_ASSIGN);           // id, expr
+// condition, _then (, _else)
+CODE_TEMPLATE(if_template, TEMPLATE_IF_STATEMENT);
+CODE_TEMPLATE(if_else_template, TEMPLATE_IF_ELSE_STATEMENT);
+// module, version, names
+CODE_TEMPLATE(runtime_import_template, TEMPLATE_RUNTIME_IMPORT);
+CODE_TEMPLATE(record_loop_template, TEMPLATE_RECORD_LOOP);
+CODE_TEMPLATE(print_template, TEMPLATE_PRINT); // value
+CODE_TEMPLATE(save_template, TEMPLATE_SAVE);   // saved, id
+
+CODE_TEMPLATE(cpp_string_template, CPP_TEMPLATE_STRING_CONST); // value
+CODE_TEMPLATE(cpp_int_template, CPP_TEMPLATE_INT_CONST);       // value
+CODE_TEMPLATE(cpp_bool_template, CPP_TEMPLATE_BOOL_CONST);     // value
+CODE_TEMPLATE(cpp_var_template, CPP_TEMPLATE_VAR);             // id
+CODE_TEMPLATE(cpp_property_template, CPP_TEMPLATE_PROPERTY);   // owner, prop
+CODE_TEMPLATE(cpp_var_def_template, CPP_TEMPLATE_VAR_DEF);     // name
+CODE_TEMPLATE(cpp_func_call_template, CPP_TEMPLATE_FUNC_CALL); // name, params
+// name, e1, e2, op
+CODE_TEMPLATE(cpp_operation_template, CPP_TEMPLATE_OPERATION);
+CODE_TEMPLATE(cpp_var_decl_template, CPP_TEMPLATE_VAR_DECL); // name, init, type
+CODE_TEMPLATE(cpp_prop_decl_template, CPP_TEMPLATE_PROP_DECL); // owner, name
+CODE_TEMPLATE(cpp_assign_template, CPP_TEMPLATE_ASSIGN);       // id, expr
+// condition, _then (, _else)
+CODE_TEMPLATE(cpp_if_template, CPP_TEMPLATE_IF_STATEMENT);
+CODE_TEMPLATE(cpp_if_else_template, CPP_TEMPLATE_IF_ELSE_STATEMENT);
+CODE_TEMPLATE(cpp_print_template, CPP_TEMPLATE_PRINT); // value
+CODE_TEMPLATE(cpp_save_template, CPP_TEMPLATE_SAVE);   // saved, id
+// inputs, id, saved, call
+CODE_TEMPLATE(cpp_reuse_template, CPP_TEMPLATE_REUSE);
+CODE_TEMPLATE(cpp_program_template, CPP_TEMPLATE_PROGRAM); // body
+
 #endif
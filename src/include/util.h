@@ -23,12 +23,17 @@
 
 using namespace std;
 
+#define _VERSION_ "1.0.0"
+
 extern const char *token_to_string(int tok);
-extern void print_token(int tok);
+extern void print_token(std::ostream &str, int tok, const YYSTYPE &lval);
 extern void print_escaped_string(std::ostream &str, const char *s);
 
 bool has_same_owner(Identifier *id1, Identifier *id2);
 Owner_Identifier *adjust_return_id(Identifier *id1, Identifier *id2);
 Owner_Identifier *adjust_return_id(Identifier *id);
 
+// Read the whole runtime file into runtime, reporting a missing file
+bool load_runtime(const char *runtime_filename, std::string &runtime);
+
 #endif
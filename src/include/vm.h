@@ -0,0 +1,191 @@
+/*
+  Saytring Compiler. A compiler translating Saytring to Python.
+  Copyright (C) 2024 Haoyuan Li
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef _VM_H_
+#define _VM_H_
+
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Expression;
+class Symbol;
+
+// The bytecode --run executes in process, instead of running the Python
+// output. An instruction is its opcode followed by its operands. An operand
+// naming a variable is its slot, one for each variable and property; an
+// operand naming any value is a slot too, or ~register of a value register,
+// which holds a constant or the result of a comparison or an arithmetic.
+
+// The opcodes with their operands, each a variable slot (V), any value
+// (A), a value register (R), the position of an instruction (J), an Op of
+// runtime/runtime.h (O), a DataType of it (T), or a count n of variable
+// slots following (N):
+//   HALT
+//   DECL slot, value, type           slot = SaytringVar(value, type)
+//   CLEAR slot                       slot = SaytringVar()
+//   ASSIGN slot, value               slot.set_value(value)
+//   SAVE slot, from                  slot = from, a copy
+//   COMP register, value, value, op  see comp() of runtime.py
+//   ARITH register, value, value, op see arithmetic() of runtime.py
+//   JUMP target
+//   JUMP_UNLESS value, target        unless _bool_wrap(value)
+//   REUSE saved, slot, target, n, n slots
+//                                    slot = saved and jump to target, as
+//                                    _reuse() would, if no slot is NULL_TYPE
+//   PRINT register                   print(register)
+#define VM_CORE_OPS(X)                                                         \
+  X(HALT, ) X(DECL, VAT) X(CLEAR, V) X(ASSIGN, VA) X(SAVE, VV) X(COMP, RAAO)   \
+      X(ARITH, RAAO) X(JUMP, J) X(JUMP_UNLESS, AJ) X(REUSE, VVJN) X(PRINT, R)
+
+// The built-ins of runtime.py, each an opcode of its own. Its operands are
+// the params of the Python function: a variable (V) or any value (A).
+// to_lower and to_upper are left out: runtime/runtime.h maps ASCII letters
+// only, where Python maps all of Unicode, so a program calling them is run
+// with python.
+#define VM_BUILTINS(X)                                                         \
+  X(CAST_INT_TO_STR, cast_int_to_str, VV)                                      \
+  X(CAST_INT_TO_BOOL, cast_int_to_bool, VV)                                    \
+  X(CAST_STR_TO_INT, cast_str_to_int, VV)                                      \
+  X(CAST_STR_TO_BOOL, cast_str_to_bool, VV)                                    \
+  X(CAST_BOOL_TO_STR, cast_bool_to_str, VV)                                    \
+  X(CAST_BOOL_TO_INT, cast_bool_to_int, VV)                                    \
+  X(CAST_LIST_TO_STR, cast_list_to_str, VV)                                    \
+  X(CAST_NULL_TO_STR, cast_null_to_str, VV)                                    \
+  X(CAST_NULL_TO_INT, cast_null_to_int, VV)                                    \
+  X(CAST_NULL_TO_BOOL, cast_null_to_bool, VV)                                  \
+  X(CONCAT, concat, VAV)                                                       \
+  X(SUBSTRING, substring, VAAV)                                                \
+  X(SUBSTRING_FROM_START, substring_from_start, VAV)                           \
+  X(GET_LENGTH, get_length, VV)                                                \
+  X(REVERSE, reverse, VV)                                                      \
+  X(IS_PALINDROME, is_palindrome, VV)                                          \
+  X(SAY, say, A)                                                               \
+  X(ASK, ask, V)                                                               \
+  X(ASK_WITH_PROMPT, ask_with_prompt, AV)                                      \
+  X(REPLACE, replace, VAAV)                                                    \
+  X(FIND, find, VAV)                                                           \
+  X(TRIM, trim, VV)                                                            \
+  X(SPLIT, split, VAV)                                                         \
+  X(GET_AT, get_at, VAV)
+
+enum VM_Opcode {
+#define VM_CORE_OPCODE(op, operands) OP_##op,
+#define VM_BUILTIN_OPCODE(op, name, params) OP_##op,
+  VM_CORE_OPS(VM_CORE_OPCODE) VM_BUILTINS(VM_BUILTIN_OPCODE)
+#undef VM_CORE_OPCODE
+#undef VM_BUILTIN_OPCODE
+      OP_COUNT
+};
+
+// The operand kinds of each opcode, the letters above
+extern const char *const vm_operand_kinds[OP_COUNT];
+
+// The operand of an expression with no value
+#define VM_NO_VALUE INT32_MIN
+
+// A constant of the program, in a value register of its own
+struct VM_Constant {
+  int32_t reg; // the value register holding it
+  enum Kind { INT, STR, BOOL } kind;
+  long long i; // INT, and BOOL as 0 or 1
+  std::string s;
+};
+
+// What vm_run() sets up to run code. In record mode, the code runs up to
+// the HALT before body once, then from body once per record, stored into
+// the variable of record_slot first. The records are independent if no
+// run can see what another stored, see Program::vm_compile(): they can
+// then be run by several threads at once.
+struct VM_Layout {
+  int32_t slot_count;
+  int32_t register_count; // constants included
+  int32_t record_slot;    // -1 out of record mode
+  int32_t body;
+  bool independent;
+};
+
+struct VM_Program {
+  std::vector<int32_t> code;
+  std::vector<VM_Constant> constants;
+  int32_t register_count = 0; // constants included
+  std::vector<std::string> slot_names; // the Python name of each slot
+  int32_t record_slot = -1;
+  int32_t body = 0;
+  bool independent = false;
+
+  VM_Layout layout() const {
+    return {(int32_t)slot_names.size(), register_count, record_slot, body,
+            independent};
+  }
+};
+
+// Lowers the checked AST to a VM_Program, see Program::vm_compile()
+class VM_Builder {
+  VM_Program &program;
+  std::unordered_map<std::string, int32_t> slots;
+  std::unordered_map<std::string, int32_t> constants;
+  // The registers of unfinished statements, and the ones free for reuse
+  std::vector<int32_t> busy_registers, free_registers;
+  bool failed = false;
+
+  int32_t slot_of(std::string name);
+  int32_t constant(VM_Constant c, const std::string &key);
+
+public:
+  VM_Builder(VM_Program &program) : program(program) {}
+
+  int32_t slot(Symbol *name);
+  int32_t slot(Symbol *owner, Symbol *name);
+  // A value register operand
+  int32_t int_constant(long long i);
+  int32_t string_constant(const std::string &s);
+  int32_t bool_constant(bool b);
+  // A value register for a result, freed when the statement ends
+  int32_t result_register();
+
+  // Append an instruction, return where it is
+  size_t emit(VM_Opcode op, std::initializer_list<int32_t> operands = {});
+  void append(int32_t operand) { program.code.push_back(operand); }
+  size_t here() const { return program.code.size(); }
+  // Make the operand at `at` the position of the next instruction
+  void patch_here(size_t at) { program.code[at] = (int32_t)here(); }
+
+  // Compile expr, a statement of its own
+  void statement(Expression *expr);
+  // The program uses something the VM cannot run as Python would
+  void fail() { failed = true; }
+  bool has_failed() const { return failed; }
+};
+
+// Run code as python would run the generated script, its output on
+// stdout, with the constants in their value registers. In record mode the
+// records are the lines read from the file descriptor records, run by jobs
+// threads if they are independent, 0 for one per core. Return the exit
+// status of python.
+int vm_run(const int32_t *code, const VM_Layout &layout,
+           const std::vector<VM_Constant> &constants, int records = 0,
+           unsigned jobs = 1);
+inline int vm_run(const VM_Program &program, int records = 0,
+                  unsigned jobs = 1) {
+  return vm_run(program.code.data(), program.layout(), program.constants,
+                records, jobs);
+}
+
+#endif
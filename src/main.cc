@@ -17,31 +17,58 @@
 */
 
 #include "AST.h"
+#include "batch.h"
+#include "cache.h"
+#include "context.h"
+#include "core_func.h"
 #include "flag_handler.h"
+#include "image.h"
+#include "report.h"
+#include "runtime.h"
+#include "semant.h"
+#include "server.h"
+#include "source.h"
+#include "symtab.h"
+#include "util.h"
+#include "vm.h"
 #include <chrono>
 #include <cstdio>
 #include <cstdlib>
-
-#define _VERSION_ "1.0.0"
+#include <fcntl.h>
+#include <memory>
+#include <sstream>
+#include <unistd.h>
 
 char *input_filename = "<stdin>";
 char *output_filename = "output.py";
 char *runtime_filename = "../runtime/runtime.py";
 
-int syntax_error_count = 0;
-int syntax_warn_count = 0;
-int semant_error_count = 0;
-int semant_warn_count = 0;
-
-extern int yylex();
-extern int yyparse();
-extern FILE *yyin;
-extern Program *ast_root; // the AST produced by the parse
-
 std::unordered_map<std::string, std::string> parsed_flags;
+Time_Report timer; // started with the process, for --time-report
+Mem_Report mem_report;
 
 void display_help();
 void display_version();
+void run_program(const VM_Program *vm = nullptr);
+int open_records();
+std::string shell_quote(const std::string &s);
+int compile_batch(std::chrono::high_resolution_clock::time_point start);
+Target compile_target();
+bool build_native();
+std::string native_filename();
+Runtime_Mode runtime_mode();
+int install_runtime();
+std::string cache_salt(const char *mode);
+void replay_cached(const std::string &log, Compile_Cache *cache,
+                   std::chrono::high_resolution_clock::time_point start);
+void print_reports();
+
+// Approximate heap bytes of a std::map: its nodes hold a value and the
+// red-black tree links and color (4 words). Values pointing elsewhere,
+// such as func_map's vectors, are not followed.
+template <class Map> size_t map_bytes(const Map &map) {
+  return map.size() * (sizeof(typename Map::value_type) + 4 * sizeof(void *));
+}
 
 int main(int argc, char **argv) {
   auto start = std::chrono::high_resolution_clock::now();
@@ -59,6 +86,52 @@ int main(int argc, char **argv) {
     return 0;
   }
 
+  // A precompiled program runs without the front end
+  if (parsed_flags["--exec"] != "<None>") {
+    VM_Image image;
+    if (!image.open(parsed_flags["--exec"].c_str()))
+      return 1;
+    // The records of a program precompiled with --records are on stdin,
+    // unless given
+    int records = 0;
+    if (parsed_flags["--records"] != "<None>") {
+      if (!image.record_mode()) {
+        std::cerr << "Error: " << parsed_flags["--exec"]
+                  << " was not precompiled with --records." << std::endl;
+        return 1;
+      }
+      if ((records = open_records()) < 0)
+        return 1;
+    }
+    return image.run(records, atoi(parsed_flags["--jobs"].c_str()));
+  }
+
+  if (parsed_flags["--target"] != "python" &&
+      parsed_flags["--target"] != "cpp") {
+    std::cerr << "Error: Unknown target " << parsed_flags["--target"]
+              << ", expected python or cpp." << std::endl;
+    return 1;
+  }
+  if (compile_target() == TARGET_CPP) {
+    if (parsed_flags["--batch"] != "<None>" ||
+        parsed_flags["--serve"] != "<None>" ||
+        parsed_flags["--install-runtime"] != "<None>" ||
+        parsed_flags["--runtime-module"] == "true" ||
+        parsed_flags["--precompile"] != "<None>" ||
+        parsed_flags["--records"] != "<None>") {
+      std::cerr << "Error: --target cpp only compiles single inputs, without "
+                   "--batch, --serve, --precompile, --records or the runtime "
+                   "package."
+                << std::endl;
+      return 1;
+    }
+    // The defaults of the flags are the Python target's
+    if (parsed_flags["--output"] == "output.py")
+      parsed_flags["--output"] = "output.cc";
+    if (parsed_flags["--runtime"] == "../runtime/runtime.py")
+      parsed_flags["--runtime"] = "../runtime/runtime.h";
+  }
+
   // Set input and output filenames based on parsed flags
   input_filename = const_cast<char *>(parsed_flags["--input"].empty()
                                           ? "<stdin>"
@@ -69,69 +142,430 @@ int main(int argc, char **argv) {
   runtime_filename = const_cast<char *>(
       parsed_flags["--runtime"].empty() ? "<stdin>"
                                         : parsed_flags["--runtime"].c_str());
-  FILE *inputFile = stdin;
-  if (input_filename != std::string("<stdin>")) {
-    inputFile = fopen(input_filename, "r");
-    if (!inputFile) {
-      perror("Failed to open file");
+  timer.lap("flag parsing");
+  bool record_mode = parsed_flags["--records"] != "<None>";
+  if (record_mode && (parsed_flags["--batch"] != "<None>" ||
+                      parsed_flags["--serve"] != "<None>")) {
+    std::cerr << "Error: --records only compiles single inputs, without "
+                 "--batch or --serve."
+              << std::endl;
+    return 1;
+  }
+  if (parsed_flags["--install-runtime"] != "<None>")
+    return install_runtime();
+  if (parsed_flags["--batch"] != "<None>")
+    return compile_batch(start);
+
+  if (parsed_flags["--serve"] != "<None>") {
+    Compile_Server server(parsed_flags["--serve"]);
+    if (!server.load_runtime(runtime_filename, runtime_mode()) ||
+        !server.listen())
+      return 1;
+    printf("Serving on %s\n", parsed_flags["--serve"].c_str());
+    fflush(stdout);
+    server.serve();
+    return 1;
+  }
+
+  install_type_cast_map();
+  install_buildin_func();
+  timer.lap("built-in installation");
+
+  // Map the whole input, the lexer scans it in place
+  Source_File source;
+  if (!source.open(input_filename)) {
+    perror("Failed to open file");
+    return 1;
+  }
+  timer.lap("input mapping");
+
+  Runtime runtime;
+  runtime.set_mode(runtime_mode());
+  runtime.set_target(compile_target());
+  if (!runtime.load(runtime_filename))
+    return 1;
+  timer.lap("runtime loading");
+
+  // Look the input up in the compile cache, which holds no bytecode to
+  // precompile or to run on the VM: a hit runs the output with python
+  bool want_precompiled = parsed_flags["--precompile"] != "<None>";
+  bool run_by_vm = compile_target() == TARGET_PYTHON &&
+                   parsed_flags["--run"] == "true" &&
+                   parsed_flags["--run-python"] != "true";
+  std::unique_ptr<Compile_Cache> cache;
+  std::string cache_key;
+  if (parsed_flags["--cache"] != "<None>" && !want_precompiled &&
+      !run_by_vm) {
+    cache.reset(new Compile_Cache(parsed_flags["--cache"]));
+    if (!cache->open())
       return 1;
+    cache_key =
+        Compile_Cache::key(cache_salt("single"), input_filename,
+                           runtime.source(), source.data(), source.length());
+    std::string log;
+    bool hit = cache->fetch(cache_key, output_filename, log);
+    timer.lap("cache lookup");
+    if (hit) {
+      replay_cached(log, cache.get(), start);
+      if (compile_target() == TARGET_CPP && !build_native())
+        return 1;
+      run_program();
+      return 0;
     }
   }
-  yyin = inputFile;
+
+  // Diagnostics are collected for the cache, and still printed phase by
+  // phase
+  std::ostringstream diag;
+  std::string log;
+  size_t syntax_log_length = 0;
+  auto flush_diag = [&]() {
+    std::cerr << diag.str() << std::flush;
+    log += diag.str();
+    diag.str("");
+  };
+  Compile_Context ctx(input_filename, &diag);
+  std::vector<AST_Node *> ast_nodes;
+  bool want_mem_report = parsed_flags["--mem-report"] == "true";
+  if (want_mem_report)
+    ctx.node_log = &ast_nodes;
 
   // Syntax Parsing
-  int parse_return = yyparse();
-  if (syntax_warn_count > 0)
+  int parse_return = ctx.parse(source.data(), source.length());
+  timer.lap("lexing and parsing");
+  flush_diag();
+  syntax_log_length = log.size();
+  if (ctx.syntax_warn_count > 0)
     printf(
         "%d syntax warnings detected, which may lead to unexpected behavior.\n",
-        syntax_warn_count);
-  if (parse_return != 0 || syntax_error_count > 0) {
+        ctx.syntax_warn_count);
+  if (parse_return != 0 || ctx.syntax_error_count > 0) {
     printf("Compilation terminated due to %d syntax errors.\n",
-           syntax_error_count);
+           ctx.syntax_error_count);
     return 0;
   }
   printf("No syntax error detected.\n");
-  if (inputFile != stdin)
-    fclose(inputFile);
+  // Every token has been interned by now
+  source.close();
 
   // Semantic Check
-  ast_root->semant_check();
-  if (semant_warn_count > 0)
+  ctx.env.record_mode = record_mode;
+  ctx.env.cpp_target = compile_target() == TARGET_CPP;
+  ctx.semant_check();
+  timer.lap("semantic check");
+  flush_diag();
+  if (ctx.env.warn_count > 0)
     printf(
         "%d semant warnings detected, which may lead to unexpected behavior.\n",
-        semant_warn_count);
-  if (semant_error_count > 0) {
+        ctx.env.warn_count);
+  if (ctx.env.error_count > 0) {
     printf("Compilation terminated due to %d semantic errors.\n",
-           semant_error_count);
+           ctx.env.error_count);
     return 0;
   }
   printf("No semantic error detected.\n");
 
+  ctx.fold_constants();
+  timer.lap("constant folding");
+  ctx.fuse_chains();
+  timer.lap("chain fusion");
+  ctx.reuse_calls();
+  timer.lap("call reuse");
+  if (record_mode) {
+    ctx.hoist_setup();
+    timer.lap("setup hoisting");
+  }
+
   // Code generation
-  ast_root->code_generation();
+  size_t generated_bytes =
+      ctx.ast_root->code_generation(output_filename, runtime, &timer);
+
+  if (want_mem_report) {
+    mem_report.add_ast_nodes(ast_nodes);
+    mem_report.add("AST arena", "used", -1, ctx.arena.bytes_used());
+    mem_report.add("AST arena", "reserved", -1, ctx.arena.bytes_reserved());
+    mem_report.add("Env", "id_map", ctx.env.id_map.size(),
+                   map_bytes(ctx.env.id_map));
+    mem_report.add("Env", "property_map", ctx.env.property_map.size(),
+                   map_bytes(ctx.env.property_map));
+    mem_report.add("Env", "func_map (shared)", ctx.env.func_map->size(),
+                   map_bytes(*ctx.env.func_map));
+    mem_report.add("code generation", "generated_code", -1, generated_bytes);
+  }
+
+  // The VM runs the program for --run, unless it takes python to run it,
+  // and --precompile saves its bytecode
+  VM_Program vm_program;
+  bool use_vm = false;
+  if (compile_target() == TARGET_PYTHON && (run_by_vm || want_precompiled)) {
+    use_vm = ctx.ast_root->vm_compile(vm_program);
+    timer.lap("bytecode compilation");
+    if (use_vm && record_mode && parsed_flags["--debug"] == "true")
+      std::cout << "Records are "
+                << (vm_program.independent ? "independent" : "dependent")
+                << std::endl;
+  }
+
+  // The whole AST is released in one go
+  ctx.release();
+  timer.lap("AST release");
+
+  if (cache) {
+    cache->store(cache_key, output_filename,
+                 std::to_string(ctx.syntax_warn_count) + " " +
+                     std::to_string(ctx.env.warn_count) + " " +
+                     std::to_string(syntax_log_length) + "\n" + log);
+    timer.lap("cache store");
+    if (parsed_flags["--debug"] == "true")
+      cache->report(std::cout);
+  }
+
+  if (want_precompiled) {
+    const char *image_filename = parsed_flags["--precompile"].c_str();
+    if (!use_vm) {
+      std::cerr << "Error: The program cannot be precompiled, as only python "
+                   "runs it the way it should."
+                << std::endl;
+      return 1;
+    }
+    if (!VM_Image::write(vm_program, image_filename))
+      return 1;
+    timer.lap("precompiled program write");
+    std::cout << "Precompiled the program to " << image_filename << std::endl;
+  }
+
+  if (compile_target() == TARGET_CPP) {
+    if (!build_native())
+      return 1;
+    timer.lap("native build");
+  }
 
   // Calculate compilation time
   auto end = std::chrono::high_resolution_clock::now();
   std::chrono::duration<double> diff = end - start;
   std::cout << "\nCompilation completed in " << diff.count() << " seconds.\n";
+  print_reports();
 
   printf("Compilation successful.\n");
   // printf("Ready to go ヾ(≧▽≦*)o\n");
   printf("Ready to go :p\n");
 
-  // Run code if --run flag is set to "true"
+  run_program(use_vm && run_by_vm ? &vm_program : nullptr);
+  return 0;
+}
+
+// Run code if --run flag is set to "true": by vm if given, else the output
+void run_program(const VM_Program *vm) {
   if (parsed_flags["--run"] == "true") {
     printf("\n--------Saytring v%s--------\n", _VERSION_);
-    int result = system(("python " + std::string(output_filename)).c_str());
+    fflush(stdout);
+    if (vm) {
+      int records = 0;
+      if (vm->record_slot >= 0 && (records = open_records()) < 0)
+        return;
+      unsigned jobs = atoi(parsed_flags["--jobs"].c_str());
+      if (vm_run(*vm, records, jobs) != 0)
+        printf("Error: The program exited with an error.\n");
+      if (records > 0)
+        close(records);
+      return;
+    }
+    if (compile_target() == TARGET_CPP) {
+      std::string binary = native_filename();
+      if (binary.find('/') == std::string::npos)
+        binary = "./" + binary;
+      if (system(binary.c_str()) != 0)
+        printf("Error: The native program exited with an error.\n");
+      return;
+    }
+    // The script reads the files named after it, stdin if none
+    std::string command = "python " + std::string(output_filename);
+    if (parsed_flags["--records"] != "<None>" &&
+        parsed_flags["--records"] != "-")
+      command += " " + shell_quote(parsed_flags["--records"]);
+    int result = system(command.c_str());
     if (result != 0) {
       printf("Error: Failed to execute the generated Python script.\n");
       printf("Suggestion: Ensure Python is installed and accessible in your "
              "PATH. Check the script for any runtime errors.\n");
     }
   }
+}
+
+// The file descriptor of the --records file, stdin for -. Return -1 if it
+// cannot be opened.
+int open_records() {
+  const std::string &filename = parsed_flags["--records"];
+  if (filename == "-")
+    return 0;
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    perror("Failed to open records");
+  return fd;
+}
+
+// s in single quotes, for system()
+std::string shell_quote(const std::string &s) {
+  std::string quoted = "'";
+  for (char c : s)
+    quoted += c == '\'' ? std::string("'\\''") : std::string(1, c);
+  return quoted + "'";
+}
+
+// Compile many inputs in one process, see Batch_Compiler
+int compile_batch(std::chrono::high_resolution_clock::time_point start) {
+  // The default output file name makes no sense for a batch: without an
+  // explicit --output directory, outputs go next to their inputs
+  std::string output_dir = parsed_flags["--output"] == "output.py"
+                               ? ""
+                               : parsed_flags["--output"];
+  Batch_Compiler batch;
+  if (!batch.add_inputs(parsed_flags["--batch"], output_dir) ||
+      !batch.load_runtime(runtime_filename, runtime_mode()))
+    return 1;
 
+  std::unique_ptr<Compile_Cache> cache;
+  if (parsed_flags["--cache"] != "<None>") {
+    cache.reset(new Compile_Cache(parsed_flags["--cache"]));
+    if (!cache->open())
+      return 1;
+    batch.use_cache(cache.get(), cache_salt("batch"));
+  }
+
+  int failed = batch.run(atoi(parsed_flags["--jobs"].c_str()));
+
+  auto end = std::chrono::high_resolution_clock::now();
+  std::chrono::duration<double> diff = end - start;
+  printf("\nCompiled %zu files (%d failed) in %g seconds.\n", batch.size(),
+         failed, diff.count());
+  if (cache && parsed_flags["--debug"] == "true")
+    cache->report(std::cout);
+  return failed > 0 ? 1 : 0;
+}
+
+Target compile_target() {
+  return parsed_flags["--target"] == "cpp" ? TARGET_CPP : TARGET_PYTHON;
+}
+
+// The binary built from output_filename: its name without the extension
+std::string native_filename() {
+  std::string name = output_filename;
+  size_t dot = name.rfind('.');
+  if (dot == std::string::npos || dot == 0 || name[dot - 1] == '/' ||
+      name.find('/', dot) != std::string::npos)
+    return name + ".out";
+  return name.substr(0, dot);
+}
+
+// Build the generated C++ into native_filename() with $CXX, c++ if unset
+bool build_native() {
+  const char *cxx = getenv("CXX");
+  std::string command = std::string(cxx && *cxx ? cxx : "c++") +
+                        " -std=c++17 -O2 -o " + native_filename() + " " +
+                        output_filename;
+  if (system(command.c_str()) != 0) {
+    printf("Error: Failed to build %s into a native binary.\n",
+           output_filename);
+    printf("Suggestion: Ensure a C++17 compiler is installed, or set CXX to "
+           "one.\n");
+    return false;
+  }
+  std::cout << "Built native binary " << native_filename() << std::endl;
+  return true;
+}
+
+// How the runtime gets into the output, see Runtime
+Runtime_Mode runtime_mode() {
+  if (parsed_flags["--runtime-module"] == "true")
+    return RUNTIME_MODULE;
+  if (parsed_flags["--full-runtime"] == "true")
+    return RUNTIME_FULL;
+  return RUNTIME_USED;
+}
+
+// Install the runtime as a package for --runtime-module, and have Python
+// compile it once, so that the programs importing it do not have to
+int install_runtime() {
+  const std::string &dir = parsed_flags["--install-runtime"];
+  Runtime runtime;
+  if (!runtime.load(runtime_filename) || !runtime.install(dir))
+    return 1;
+  std::string package = dir + "/" RUNTIME_MODULE_NAME;
+  if (system(("python -m compileall -q " + package).c_str()) != 0)
+    printf("Warning: Failed to compile %s to bytecode, Python will compile "
+           "it on first import if it can write there.\n",
+           package.c_str());
+  printf("Installed %s %s to %s\n", RUNTIME_MODULE_NAME,
+         runtime.version().c_str(), package.c_str());
   return 0;
 }
+
+// Everything but the input and the runtime that the output depends on.
+// mode keeps apart the entries of single and batch compilations, whose
+// logs differ.
+std::string cache_salt(const char *mode) {
+  static const char *runtime_modes[] = {"", " full-runtime",
+                                        " runtime-module"};
+  return std::string("saytringc ") + _VERSION_ + " " + mode +
+         runtime_modes[runtime_mode()] +
+         (compile_target() == TARGET_CPP ? " cpp" : "") +
+         (parsed_flags["--records"] != "<None>" ? " records" : "");
+}
+
+// Report a cache hit as if the input had just been compiled. The log
+// holds the warning counts and the length of the syntax diagnostics,
+// followed by the syntax and semant diagnostics.
+void replay_cached(const std::string &log, Compile_Cache *cache,
+                   std::chrono::high_resolution_clock::time_point start) {
+  int syntax_warn_count = 0, semant_warn_count = 0;
+  size_t syntax_log_length = 0;
+  std::istringstream in(log);
+  in >> syntax_warn_count >> semant_warn_count >> syntax_log_length;
+  std::string diag = log.substr(std::min<size_t>(log.size(), in.tellg()) + 1);
+  syntax_log_length = std::min(syntax_log_length, diag.size());
+
+  std::cerr << diag.substr(0, syntax_log_length) << std::flush;
+  if (syntax_warn_count > 0)
+    printf(
+        "%d syntax warnings detected, which may lead to unexpected behavior.\n",
+        syntax_warn_count);
+  printf("No syntax error detected.\n");
+  fflush(stdout);
+  std::cerr << diag.substr(syntax_log_length) << std::flush;
+  if (semant_warn_count > 0)
+    printf(
+        "%d semant warnings detected, which may lead to unexpected behavior.\n",
+        semant_warn_count);
+  printf("No semantic error detected.\n");
+  std::cout << "Generated code to " << output_filename << std::endl;
+  if (parsed_flags["--debug"] == "true")
+    cache->report(std::cout);
+
+  auto end = std::chrono::high_resolution_clock::now();
+  std::chrono::duration<double> diff = end - start;
+  std::cout << "\nCompilation completed in " << diff.count() << " seconds.\n";
+  print_reports();
+
+  printf("Compilation successful.\n");
+  printf("Ready to go :p\n");
+}
+
+// Print the reports asked for on the command line
+void print_reports() {
+  bool json = parsed_flags["--report-format"] == "json";
+  if (parsed_flags["--time-report"] == "true")
+    timer.print(std::cout, json);
+  if (parsed_flags["--mem-report"] == "true") {
+    mem_report.add("symbol tables", "id_tab", id_tab->size(), id_tab->bytes());
+    mem_report.add("symbol tables", "str_tab", str_tab->size(),
+                   str_tab->bytes());
+    mem_report.add("symbol tables", "int_tab", int_tab->size(),
+                   int_tab->bytes());
+    mem_report.add_peak_rss();
+    mem_report.print(std::cout, json);
+  }
+}
+
 void display_version() {
   std::cout << "Saytring Compiler v" << _VERSION_ << "\n" << std::endl;
   std::cout << "Copyright (C) 2024 Haoyuan Li" << std::endl;
@@ -0,0 +1,536 @@
+/*
+  Saytring Compiler. A compiler translating Saytring to Python.
+  Copyright (C) 2024 Haoyuan Li
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "AST.h"
+#include "symtab.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/*----------------------------------.
+|  Constant folding and pruning     |
+`----------------------------------*/
+
+// Folding has to give what the runtime would compute: arithmetic() and
+// comp() on the same operands. Anything the runtime would complain about
+// (mixed types, a non-bool condition) is left to it.
+
+// The text of a string constant, if it has no escapes. Escaped strings are
+// left alone, their value is up to Python.
+static bool string_value(Expression *expr, std::string_view &value) {
+  String_Const_Expr *str = dynamic_cast<String_Const_Expr *>(expr);
+  if (!str)
+    return false;
+  value = std::string_view(str->token->get_string(), str->token->get_len());
+  return value.find('\\') == std::string_view::npos;
+}
+
+// The value of an int constant, if Python reads it the same way and it
+// fits in 64 bits. Python rejects leading zeros, so those are left alone.
+static bool int_value(Expression *expr, long long &value) {
+  Int_Const_Expr *num = dynamic_cast<Int_Const_Expr *>(expr);
+  if (!num)
+    return false;
+  const char *s = num->token->get_string();
+  const char *digits = s[0] == '-' ? s + 1 : s;
+  if (digits[0] == '0' && digits[1] != '\0')
+    return false;
+  errno = 0;
+  char *end;
+  value = strtoll(s, &end, 10);
+  return errno == 0 && *end == '\0';
+}
+
+static Expression *new_string_const(std::string_view value, YYLTYPE loc) {
+  Expression *expr = new String_Const_Expr(
+      str_tab->add_string(value.data(), value.size()), loc);
+  expr->type = _string;
+  return expr;
+}
+
+static Expression *new_int_const(long long value, YYLTYPE loc) {
+  char buf[32];
+  int len = snprintf(buf, sizeof(buf), "%lld", value);
+  Expression *expr = new Int_Const_Expr(int_tab->add_string(buf, len), loc);
+  expr->type = _int;
+  return expr;
+}
+
+static Expression *new_bool_const(bool value, YYLTYPE loc) {
+  Expression *expr = new Bool_Const_Expr(value, loc);
+  expr->type = _bool;
+  return expr;
+}
+
+// The branch a conditional always takes, or nullptr if it is not constant
+static Expression_List *constant_branch(Expression *expr) {
+  Cond_Expr *cond = dynamic_cast<Cond_Expr *>(expr);
+  if (!cond)
+    return nullptr;
+  Bool_Const_Expr *pred = dynamic_cast<Bool_Const_Expr *>(cond->predictor);
+  if (!pred)
+    return nullptr;
+  return pred->value ? cond->_then_list : cond->_else_list;
+}
+
+// Fold every expression of list, splicing in the branch taken by constant
+// conditionals. The list is updated in place unless a branch was spliced.
+static Expression_List *fold_list(Expression_List *list) {
+  Expression_List *folded = nullptr;
+  for (size_t i = 0; i < list->size(); i++) {
+    Expression *expr = (*list)[i]->fold();
+    Expression_List *taken = constant_branch(expr);
+    if (!taken && !folded) {
+      (*list)[i] = expr;
+      continue;
+    }
+    if (!folded) {
+      folded = new_expr_list();
+      folded->assign(list->begin(), list->begin() + i);
+    }
+    if (taken)
+      folded->insert(folded->end(), taken->begin(), taken->end());
+    else
+      folded->push_back(expr);
+  }
+  return folded ? folded : list;
+}
+
+void Program::fold_constants() { expr_list = fold_list(expr_list); }
+
+Expression *Var_Decl_Expr::fold() {
+  init = init->fold();
+  return this;
+}
+
+Expression *Assi_Expr::fold() {
+  expr = expr->fold();
+  return this;
+}
+
+Expression *Direct_Call_Expr::fold() {
+  for (Expression *&arg : *arg_list)
+    arg = arg->fold();
+  return this;
+}
+
+Expression *Cond_Expr::fold() {
+  predictor = predictor->fold();
+  _then_list = fold_list(_then_list);
+  _else_list = fold_list(_else_list);
+  return this;
+}
+
+Expression *Comp_Expr::fold() {
+  e1 = e1->fold();
+  e2 = e2->fold();
+
+  int order;
+  std::string_view s1, s2;
+  long long i1, i2;
+  if (string_value(e1, s1) && string_value(e2, s2))
+    // Byte order of UTF-8 is code point order, as Python compares
+    order = s1.compare(s2);
+  else if (int_value(e1, i1) && int_value(e2, i2))
+    order = i1 < i2 ? -1 : i1 > i2;
+  else
+    return this;
+
+  bool value;
+  if (op == _EQ)
+    value = order == 0;
+  else if (op == _NE)
+    value = order != 0;
+  else if (op == _LT)
+    value = order < 0;
+  else if (op == _LE)
+    value = order <= 0;
+  else if (op == _GT)
+    value = order > 0;
+  else if (op == _GE)
+    value = order >= 0;
+  else
+    return this;
+  return new_bool_const(value, location);
+}
+
+Expression *Arith_Expr::fold() {
+  e1 = e1->fold();
+  e2 = e2->fold();
+
+  std::string_view s1, s2;
+  long long i1, i2, value;
+  if (string_value(e1, s1) && string_value(e2, s2)) {
+    if (op == _ADD)
+      return new_string_const(std::string(s1).append(s2), location);
+    // _remove_tail(): s[:-len(tail)] if s ends with tail, so removing ""
+    // gives ""
+    if (op == _SUB) {
+      std::string_view rest = s1;
+      if (s1.size() >= s2.size() && s1.substr(s1.size() - s2.size()) == s2)
+        rest = s2.empty() ? s2 : s1.substr(0, s1.size() - s2.size());
+      return new_string_const(rest, location);
+    }
+  } else if (int_value(e1, i1) && int_value(e2, i2)) {
+    // Python ints do not overflow, leave those to it
+    if (op == _ADD && !__builtin_add_overflow(i1, i2, &value))
+      return new_int_const(value, location);
+    if (op == _SUB && !__builtin_sub_overflow(i1, i2, &value))
+      return new_int_const(value, location);
+  }
+  return this;
+}
+
+/*----------------------------------.
+|  Chain call fusion                |
+`----------------------------------*/
+
+// parser.y turns `x do trim -> do to_lower -> do reverse` into one call per
+// step, each storing its result in x's last_result for the next one to read
+// back. Steps storing into the same place overwrite each other, so only
+// the last result can ever be seen: a run of them is fused into a
+// Chain_Call_Expr, which computes on plain strings and stores once. The
+// runtime's _str_chain() still makes the calls one by one when a value
+// turns out not to be a string.
+
+// The Python name of an identifier: a property is <owner>_<name>
+static std::string python_name(Identifier *id) {
+  if (id->has_owner()) {
+    Owner_Identifier *owner_id = static_cast<Owner_Identifier *>(id);
+    return std::string(owner_id->owner_name->get_string())
+        .append("_")
+        .append(owner_id->name->get_string());
+  }
+  return static_cast<Single_Identifier *>(id)->name->get_string();
+}
+
+static bool is_anonymous(Identifier *id) {
+  return !id->has_owner() && !id->is_nil() &&
+         static_cast<Single_Identifier *>(id)->name == _anonymous;
+}
+
+enum Chain_Step { NOT_A_STEP, STRING_STEP, LAST_STEP };
+
+// What call can be in a chain storing into target: a built-in giving a
+// string, one giving something else that has to end the chain, or neither.
+// Its argument is read before the chain runs, so it cannot be target.
+static Chain_Step chain_step(Direct_Call_Expr *call,
+                             const std::string &target) {
+  if (call->id->is_nil() || call->return_id->is_nil() ||
+      python_name(call->return_id) != target)
+    return NOT_A_STEP;
+  const char *name = call->func_name->get_string();
+  if (strcmp(name, "concat") == 0) {
+    if (call->arg_list->size() != 1)
+      return NOT_A_STEP;
+    Expression *arg = call->arg_list->at(0);
+    Identifier *arg_id = dynamic_cast<Identifier *>(arg);
+    if (arg->type != _string ||
+        !(dynamic_cast<String_Const_Expr *>(arg) ||
+          (arg_id && python_name(arg_id) != target)))
+      return NOT_A_STEP;
+    return STRING_STEP;
+  }
+  if (!call->arg_list->empty())
+    return NOT_A_STEP;
+  for (const char *step : {"reverse", "to_lower", "to_upper", "trim"})
+    if (strcmp(name, step) == 0)
+      return STRING_STEP;
+  for (const char *step : {"get_length", "is_palindrome"})
+    if (strcmp(name, step) == 0)
+      return LAST_STEP;
+  return NOT_A_STEP;
+}
+
+// The Chain_Call_Expr of the calls from list[begin] on, setting end past
+// them, or nullptr if there are no two calls to fuse there. A chain on a
+// constant takes its assignment to _anonymous, which nothing else reads, as
+// its first call.
+static Expression *fuse_chain(Expression_List &list, size_t begin,
+                              size_t &end) {
+  Expression *source = nullptr;
+  size_t i = begin;
+  if (Assi_Expr *assi = dynamic_cast<Assi_Expr *>(list[i])) {
+    if (!is_anonymous(assi->id) ||
+        !dynamic_cast<String_Const_Expr *>(assi->expr))
+      return nullptr;
+    source = assi->expr;
+    i++;
+  }
+
+  Expression_List *steps = new_expr_list();
+  std::string target;
+  for (; i < list.size(); i++) {
+    Direct_Call_Expr *call = dynamic_cast<Direct_Call_Expr *>(list[i]);
+    if (!call)
+      break;
+    if (steps->empty()) {
+      // The first step reads the caller, a string
+      if (source ? !is_anonymous(call->id) : call->id->type != _string)
+        break;
+      if (!call->return_id->is_nil())
+        target = python_name(call->return_id);
+    } else if (python_name(call->id) != target) {
+      break;
+    }
+    Chain_Step step = chain_step(call, target);
+    if (step == NOT_A_STEP)
+      break;
+    steps->push_back(call);
+    if (step == LAST_STEP) {
+      i++;
+      break;
+    }
+  }
+
+  if (steps->size() + (source != nullptr) < 2)
+    return nullptr;
+  end = i;
+  Direct_Call_Expr *first = static_cast<Direct_Call_Expr *>(steps->front());
+  Direct_Call_Expr *last = static_cast<Direct_Call_Expr *>(steps->back());
+  Expression *chain = new Chain_Call_Expr(source ? source : first->id, steps,
+                                          last->return_id, first->location);
+  chain->type = last->type;
+  return chain;
+}
+
+void Program::fuse_chains() {
+  Expression_List &list = *expr_list;
+  size_t kept = 0;
+  for (size_t i = 0; i < list.size();) {
+    size_t end;
+    if (Expression *chain = fuse_chain(list, i, end)) {
+      list[kept++] = chain;
+      i = end;
+    } else {
+      list[kept++] = list[i++];
+    }
+  }
+  list.erase(list.begin() + kept, list.end());
+}
+
+/*----------------------------------.
+|  Reuse of pure calls              |
+`----------------------------------*/
+
+// These built-ins give the same result on the same inputs and store
+// nothing but it. They read their caller and arguments as strings, so given
+// variables and string constants they only fail, with the same warnings,
+// if one of the variables is NULL_TYPE. A call repeating an earlier one on
+// unchanged inputs can then store the earlier result instead, which is
+// what the runtime's _reuse() does. Another constant, such as an int, fails
+// every time, and such a call is not reused.
+static const char *const pure_builtins[] = {
+    "concat",  "find",  "get_length", "is_palindrome", "replace",
+    "reverse", "split", "to_lower",   "to_upper",      "trim"};
+
+// Every store into a variable or property gives it a new version, by its
+// Python name
+typedef std::unordered_map<std::string, unsigned> Versions;
+
+// Where the result of a call of a pure built-in is
+struct Call_Result {
+  size_t index;       // of the last call storing it in the list
+  Identifier *holder; // the return_id of that call
+  unsigned version;   // of holder, while it still holds the result
+  Identifier *saved;  // a copy kept by a Save_Expr, or nullptr
+};
+
+// The key of a call of a pure built-in: its name and the versions of its
+// inputs, which can only be met again while none of them changed. Empty
+// if the call is not one, or takes something else than string constants
+// and identifiers.
+static std::string call_key(Direct_Call_Expr *call, Versions &versions) {
+  std::string key;
+  if (call->id->is_nil() || call->return_id->is_nil())
+    return key;
+  const char *name = call->func_name->get_string();
+  for (const char *builtin : pure_builtins)
+    if (strcmp(name, builtin) == 0)
+      key = name;
+  if (key.empty())
+    return key;
+
+  auto add_input = [&](Expression *input) {
+    key += '\0';
+    if (String_Const_Expr *str = dynamic_cast<String_Const_Expr *>(input))
+      key.append("s").append(str->token->get_string());
+    else if (Identifier *id = dynamic_cast<Identifier *>(input)) {
+      std::string id_name = python_name(id);
+      key.append("v").append(id_name).append("#").append(
+          std::to_string(versions[id_name]));
+    } else
+      return false;
+    return true;
+  };
+  if (!add_input(call->id))
+    return "";
+  for (Expression *arg : *call->arg_list)
+    if (!add_input(arg))
+      return "";
+  return key;
+}
+
+// Give what expr stores into new versions. Return false if it is not
+// known what it stores into.
+static bool record_stores(Expression *expr, Versions &versions) {
+  if (Var_Decl_Expr *decl = dynamic_cast<Var_Decl_Expr *>(expr)) {
+    versions[decl->identifier->get_string()]++;
+  } else if (Property_Decl_Expr *decl =
+                 dynamic_cast<Property_Decl_Expr *>(expr)) {
+    versions[python_name(decl->owner_id).append("_").append(
+        decl->property_name->get_string())]++;
+  } else if (Assi_Expr *assi = dynamic_cast<Assi_Expr *>(expr)) {
+    versions[python_name(assi->id)]++;
+  } else if (Cast_Expr *cast = dynamic_cast<Cast_Expr *>(expr)) {
+    // Casts convert id in place, and store whether they succeeded
+    versions[python_name(cast->id)]++;
+    versions[python_name(cast->return_id)]++;
+  } else if (Direct_Call_Expr *call = dynamic_cast<Direct_Call_Expr *>(expr)) {
+    if (!call->return_id->is_nil())
+      versions[python_name(call->return_id)]++;
+  } else if (Chain_Call_Expr *chain = dynamic_cast<Chain_Call_Expr *>(expr)) {
+    versions[python_name(chain->return_id)]++;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+void Program::reuse_calls() {
+  Expression_List &list = *expr_list;
+  Versions versions;
+  std::unordered_map<std::string, Call_Result> results;
+  // Save_Exprs to put after the calls at their index
+  std::vector<std::pair<size_t, Save_Expr *>> saves;
+
+  for (size_t i = 0; i < list.size(); i++) {
+    Direct_Call_Expr *call = dynamic_cast<Direct_Call_Expr *>(list[i]);
+    std::string key = call ? call_key(call, versions) : "";
+    auto found = key.empty() ? results.end() : results.find(key);
+    bool reused = found != results.end();
+    if (reused) {
+      Call_Result &result = found->second;
+      Identifier *saved = result.holder;
+      if (versions[python_name(result.holder)] != result.version) {
+        // The result has been overwritten since, keep a copy from then on
+        if (!result.saved) {
+          std::string name = "_saved" + std::to_string(saves.size() + 1);
+          result.saved = new Single_Identifier(
+              id_tab->add_string(name.data(), name.size()), call->location);
+          saves.push_back(std::make_pair(
+              result.index,
+              new Save_Expr(result.holder, result.saved, call->location)));
+        }
+        saved = result.saved;
+      }
+      list[i] = new Reused_Call_Expr(call, saved, call->location);
+    }
+
+    // Conditionals, and anything else storing in ways not followed here,
+    // make every result unknown
+    if (!record_stores(call ? call : list[i], versions)) {
+      results.clear();
+      continue;
+    }
+    if (key.empty())
+      continue;
+    Call_Result &result = results[key];
+    result.index = i;
+    result.holder = call->return_id;
+    result.version = versions[python_name(call->return_id)];
+    if (!reused)
+      result.saved = nullptr;
+  }
+
+  if (saves.empty())
+    return;
+  std::sort(saves.begin(), saves.end(),
+            [](const std::pair<size_t, Save_Expr *> &a,
+               const std::pair<size_t, Save_Expr *> &b) {
+              return a.first < b.first;
+            });
+  Expression_List *saved_list = new_expr_list();
+  auto save = saves.begin();
+  for (size_t i = 0; i < list.size(); i++) {
+    saved_list->push_back(list[i]);
+    for (; save != saves.end() && save->first == i; ++save)
+      saved_list->push_back(save->second);
+  }
+  expr_list = saved_list;
+}
+
+/*----------------------------------.
+|  Record setup hoisting            |
+`----------------------------------*/
+
+// In record mode expr_list runs once per record. A declaration of a
+// constant that nothing else stores into gives the same value in every
+// run: it is made once, before the first record, instead.
+
+// Count what the statements of list store into, by Python name, in the
+// branches of conditionals too. Return false if it is not known.
+static bool count_stores(Expression_List *list, Versions &stores) {
+  for (Expression *expr : *list) {
+    if (Cond_Expr *cond = dynamic_cast<Cond_Expr *>(expr)) {
+      if (!count_stores(cond->_then_list, stores) ||
+          !count_stores(cond->_else_list, stores))
+        return false;
+    } else if (Save_Expr *save = dynamic_cast<Save_Expr *>(expr)) {
+      stores[python_name(save->saved)]++;
+    } else if (Reused_Call_Expr *reused =
+                   dynamic_cast<Reused_Call_Expr *>(expr)) {
+      record_stores(reused->call, stores);
+    } else if (dynamic_cast<Cond_Call_Expr *>(expr)) {
+      return false;
+    } else {
+      // Anything else record_stores() does not know stores nothing
+      record_stores(expr, stores);
+    }
+  }
+  return true;
+}
+
+void Program::hoist_setup() {
+  setup_list = new_expr_list();
+  Versions stores;
+  // Each record is stored into record before the run
+  stores[RECORD->get_string()]++;
+  if (!count_stores(expr_list, stores))
+    return;
+
+  Expression_List *body = new_expr_list();
+  for (Expression *expr : *expr_list) {
+    bool constant = false;
+    if (Var_Decl_Expr *decl = dynamic_cast<Var_Decl_Expr *>(expr))
+      constant = dynamic_cast<Const_Expr *>(decl->init) != nullptr &&
+                 stores[decl->identifier->get_string()] == 1;
+    else if (Property_Decl_Expr *decl =
+                 dynamic_cast<Property_Decl_Expr *>(expr))
+      constant = stores[python_name(decl->owner_id).append("_").append(
+                     decl->property_name->get_string())] == 1;
+    (constant ? setup_list : body)->push_back(expr);
+  }
+  expr_list = body;
+}
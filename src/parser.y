@@ -21,37 +21,43 @@
 #include <vector>
 #include "symtab.h"
 #include "AST.h"
+#include "context.h"
 #include "util.h"
 
-extern char *input_filename;
-extern int syntax_error_count;
-extern int syntax_warn_count;
-
 // YYLTYPE is defined in AST.h
 #define YYLTYPE_IS_DECLARED 1
 #define YYLTYPE_IS_TRIVIAL 1
 
-void yywarn(const char *s, YYLTYPE loc);
-void yyerror(const char *s, YYLTYPE loc);
-void yyerror(const char *s);
+void yywarn(Compile_Context *ctx, const char *s, YYLTYPE loc);
+void yyerror(Compile_Context *ctx, const char *s, YYLTYPE loc, int tok,
+             const YYSTYPE &lval);
+void yyerror(YYLTYPE *loc, yyscan_t scanner, Compile_Context *ctx,
+             const char *s);
 
-void parse_funcs(Identifier *caller);
+void parse_funcs(Compile_Context *ctx, Identifier *caller, YYLTYPE loc);
 
-extern int yylex();
+extern int yylex(YYSTYPE *lval, YYLTYPE *lloc, yyscan_t scanner);
 
-Program *ast_root;            /* the result of the parse  */
+%}
 
-// Temp variables
-// TODO: Can use stack to manage `has_pushed_back`
-bool has_pushed_back = false;
+%code requires {
+#include <vector>
+#include "arena.h"
 
-std::vector<Expression *> *global_expr_list = new std::vector<Expression *>;
-std::vector<Expression *> *temp_expr_list;
-std::vector<Symbol *> *temp_identifier_list = new std::vector<Symbol *>;
-std::vector<Call_Expr *> *temp_call_list = new std::vector<Call_Expr *>;
-Identifier *temp_return_id;
+class Expression;
+class Compile_Context;
+typedef std::vector<Expression *, Arena_Allocator<Expression *>> Expression_List;
 
-%}
+#ifndef YY_TYPEDEF_YY_SCANNER_T
+#define YY_TYPEDEF_YY_SCANNER_T
+typedef void *yyscan_t;
+#endif
+}
+
+/* Reentrant: all parse state lives in the Compile_Context */
+%define api.pure full
+%lex-param {yyscan_t scanner}
+%parse-param {yyscan_t scanner} {Compile_Context *ctx}
 
 %locations
 
@@ -63,7 +69,7 @@ Identifier *temp_return_id;
   class Expression *expression;
   class Direct_Call_Expr *direct_call_expr;
   class Identifier *identifier;
-  std::vector<Expression *> *expressions;
+  Expression_List *expressions;
   char *error_msg;
 }
 
@@ -96,22 +102,22 @@ Identifier *temp_return_id;
 
 program : expr_list
         {
-          ast_root = new Program(global_expr_list, YYLTYPE());
+          ctx->ast_root = new Program(ctx->global_expr_list, YYLTYPE());
         }
         ;
 
 expr_list : expression
           {
             // If current expressions has been pushed back before, don't push it again
-            if (!has_pushed_back)
-              global_expr_list->push_back($1);
-            has_pushed_back = false;
+            if (!ctx->has_pushed_back)
+              ctx->global_expr_list->push_back($1);
+            ctx->has_pushed_back = false;
           }
           | expr_list expression
           {
-            if (!has_pushed_back)
-              global_expr_list->push_back($2);
-            has_pushed_back = false;
+            if (!ctx->has_pushed_back)
+              ctx->global_expr_list->push_back($2);
+            ctx->has_pushed_back = false;
           }
           ;
 
@@ -126,25 +132,25 @@ expression : assi_expr        { $$ = $1; }
            | call_expr          ;
            | expression comp_op expression ';'
            {
-             if (!has_pushed_back)
+             if (!ctx->has_pushed_back)
                $$ = new Comp_Expr($1, $2, $3, @1);
              else {
-               $$ = new Comp_Expr($1, $2, temp_return_id, @1);
-               has_pushed_back = false;
+               $$ = new Comp_Expr($1, $2, ctx->temp_return_id, @1);
+               ctx->has_pushed_back = false;
              }
            }
            | expression arith_op expression ';'
            {
-             if (!has_pushed_back)
+             if (!ctx->has_pushed_back)
                $$ = new Arith_Expr($1, $2, $3, @1);
              else {
-               $$ = new Arith_Expr($1, $2, temp_return_id, @1);
-               has_pushed_back = false;
+               $$ = new Arith_Expr($1, $2, ctx->temp_return_id, @1);
+               ctx->has_pushed_back = false;
              }
            }
            | error '\n'
            {
-             yyerror("Error in expression", yylloc);
+             yyerror(ctx, "Error in expression", yylloc, yychar, yylval);
              yyerrok;
            }
            ;
@@ -175,15 +181,15 @@ const_expr : INT_CONST
 
 decl_expr : DEFINE ID AS '(' expression ')'
           {
-            global_expr_list->push_back(new Var_Decl_Expr($2, $5, @2));
+            ctx->global_expr_list->push_back(new Var_Decl_Expr($2, $5, @2));
 
             // Automatically declare var's last_result, as well
-            global_expr_list->push_back(new Property_Decl_Expr(new Single_Identifier($2, @2), LAST_RESULT, @2));
-            has_pushed_back = true;
+            ctx->global_expr_list->push_back(new Property_Decl_Expr(new Single_Identifier($2, @2), LAST_RESULT, @2));
+            ctx->has_pushed_back = true;
           }
           | DEFINE error ')'
           {
-            yyerror("Error in variable declaration", yylloc);
+            yyerror(ctx, "Error in variable declaration", yylloc, yychar, yylval);
             yyerrok;
           }
           ;
@@ -191,17 +197,17 @@ decl_expr : DEFINE ID AS '(' expression ')'
 property_decl_expr : identifier HAS '[' dummy_identifier_list ']'
                    {
                      if ($1->has_owner())
-                       yywarn("Cannot declare property of a property!", @1);
+                       yywarn(ctx, "Cannot declare property of a property!", @1);
                      else {
-                       for (Symbol *property_name : *temp_identifier_list) {
-                         global_expr_list->push_back(new Property_Decl_Expr($1, property_name, yylloc));
+                       for (Symbol *property_name : ctx->temp_identifier_list) {
+                         ctx->global_expr_list->push_back(new Property_Decl_Expr($1, property_name, yylloc));
                        }
-                       has_pushed_back = true;
+                       ctx->has_pushed_back = true;
                      }
                    }
                    | error ']'
                    {
-                     yyerror("Error in property declaration", yylloc);
+                     yyerror(ctx, "Error in property declaration", yylloc, yychar, yylval);
                      yyerrok;
                    }
                    ;
@@ -209,32 +215,32 @@ property_decl_expr : identifier HAS '[' dummy_identifier_list ']'
 // TODO: fix order of collecting
 dummy_identifier_list : ID
                       {
-                        temp_identifier_list->clear();
-                        temp_identifier_list->push_back($1);
+                        ctx->temp_identifier_list.clear();
+                        ctx->temp_identifier_list.push_back($1);
                       }
                       | ID ',' dummy_identifier_list
                       {
-                        temp_identifier_list->push_back($1);
+                        ctx->temp_identifier_list.push_back($1);
                       }
                       | error ','
                       {
-                        yyerror("Error in property declaration", yylloc);
+                        yyerror(ctx, "Error in property declaration", yylloc, yychar, yylval);
                         yyerrok;
                       }
                       ;
 
 assi_expr : SET identifier AS '(' expression ')'
           {
-            if (!has_pushed_back)
+            if (!ctx->has_pushed_back)
               $$ = new Assi_Expr($2, $5, @2);
             else {
-              $$ = new Assi_Expr($2, temp_return_id, @2);
-              has_pushed_back = false;
+              $$ = new Assi_Expr($2, ctx->temp_return_id, @2);
+              ctx->has_pushed_back = false;
             }
           }
           | SET error ')'
           {
-            yyerror("Error in assignment", yylloc);
+            yyerror(ctx, "Error in assignment", yylloc, yychar, yylval);
             yyerrok;
           }
           ;
@@ -253,27 +259,27 @@ cast_expr : CONVERT identifier TO TYPE_CONST ON identifier
 // TODO: fix order of collecting
 parameter_list : expression
                {
-                 $$ = new std::vector<Expression *>;
-                 if (!has_pushed_back)
+                 $$ = new_expr_list();
+                 if (!ctx->has_pushed_back)
                    $$->push_back($1);
                  else {
-                   $$->push_back(temp_return_id);
-                   has_pushed_back = false;
+                   $$->push_back(ctx->temp_return_id);
+                   ctx->has_pushed_back = false;
                  }
                }
                | expression ',' parameter_list
                {
                  $$ = $3;
-                 if (!has_pushed_back)
+                 if (!ctx->has_pushed_back)
                    $$->push_back($1);
                  else {
-                   $$->push_back(temp_return_id);
-                   has_pushed_back = false;
+                   $$->push_back(ctx->temp_return_id);
+                   ctx->has_pushed_back = false;
                  }
                }
                | error ','
                {
-                 yyerror("Error in parameter list", yylloc);
+                 yyerror(ctx, "Error in parameter list", yylloc, yychar, yylval);
                  yyerrok;
                }
                ;
@@ -284,56 +290,56 @@ parameter_list : expression
   */
 call_expr : identifier dummy_chain_call_list
           {
-            parse_funcs($1);
+            parse_funcs(ctx, $1, yylloc);
           }
           | const_expr dummy_chain_call_list
           {
             Identifier *anony_caller = new Single_Identifier(_anonymous, @1);
-            global_expr_list->push_back(new Assi_Expr(anony_caller, $1, @1));
-            parse_funcs(anony_caller);
+            ctx->global_expr_list->push_back(new Assi_Expr(anony_caller, $1, @1));
+            parse_funcs(ctx, anony_caller, yylloc);
           }
           ;
 
 dummy_chain_call_list : func_expr
                       {
-                        temp_call_list->clear();
-                        temp_call_list->push_back($1);
+                        ctx->temp_call_list.clear();
+                        ctx->temp_call_list.push_back($1);
                       }
                       | func_expr CHAIN dummy_chain_call_list
                       {
-                        temp_call_list->push_back($1);
+                        ctx->temp_call_list.push_back($1);
                       }
                       | '(' IF expression THEN func_expr ')'
                       {
-                        temp_call_list->clear();
-                        if (!has_pushed_back)
-                          temp_call_list->push_back(new Cond_Call_Expr($3, $5, @3));
+                        ctx->temp_call_list.clear();
+                        if (!ctx->has_pushed_back)
+                          ctx->temp_call_list.push_back(new Cond_Call_Expr($3, $5, @3));
                         else {
-                          yywarn("Nested function call should not appear in chain call", @3);
-                          temp_call_list->push_back(new Cond_Call_Expr(temp_return_id, $5, @3));
-                          has_pushed_back = false;
+                          yywarn(ctx, "Nested function call should not appear in chain call", @3);
+                          ctx->temp_call_list.push_back(new Cond_Call_Expr(ctx->temp_return_id, $5, @3));
+                          ctx->has_pushed_back = false;
                         }
                       }
                       | '(' IF expression THEN func_expr ')' CHAIN dummy_chain_call_list
                       {
-                        if (!has_pushed_back)
-                          temp_call_list->push_back(new Cond_Call_Expr($3, $5, @3));
+                        if (!ctx->has_pushed_back)
+                          ctx->temp_call_list.push_back(new Cond_Call_Expr($3, $5, @3));
                         else {
-                          yywarn("Nested function call should not appear in chain call", @3);
-                          temp_call_list->push_back(new Cond_Call_Expr(temp_return_id, $5, @3));
-                          has_pushed_back = false;
+                          yywarn(ctx, "Nested function call should not appear in chain call", @3);
+                          ctx->temp_call_list.push_back(new Cond_Call_Expr(ctx->temp_return_id, $5, @3));
+                          ctx->has_pushed_back = false;
                         }
                       }
                       | CHAIN error
                       {
-                        yyerror("Error in chain call", yylloc);
+                        yyerror(ctx, "Error in chain call", yylloc, yychar, yylval);
                         yyerrok;
                       }
                       ;
 
 func_expr : DO ID
           {
-            $$ = new Direct_Call_Expr($2, new std::vector<Expression *>, new Single_Identifier(LAST_RESULT , @2), @2);
+            $$ = new Direct_Call_Expr($2, new_expr_list(), new Single_Identifier(LAST_RESULT , @2), @2);
           }
           | DO ID USING '[' parameter_list ']'
           {
@@ -341,7 +347,7 @@ func_expr : DO ID
           }
           | DO ID ON identifier
           {
-            $$ = new Direct_Call_Expr($2, new std::vector<Expression *>, $4, @2);
+            $$ = new Direct_Call_Expr($2, new_expr_list(), $4, @2);
           }
           | DO ID USING '[' parameter_list ']' ON identifier
           {
@@ -351,44 +357,44 @@ func_expr : DO ID
 
 predictor_expr : IF expression
                {
-                 if (!has_pushed_back)
+                 if (!ctx->has_pushed_back)
                    $$ = $2;
                  else {
-                   $$ = temp_return_id;
-                   has_pushed_back = false;
+                   $$ = ctx->temp_return_id;
+                   ctx->has_pushed_back = false;
                  }
                }
                ;
 
 then_expr_list : THEN expression
                {
-                 temp_expr_list = new std::vector<Expression *>;
-                 $$ = temp_expr_list;
-                 if (!has_pushed_back)
+                 ctx->temp_expr_list = new_expr_list();
+                 $$ = ctx->temp_expr_list;
+                 if (!ctx->has_pushed_back)
                    $$->push_back($2);
-                 has_pushed_back = false;
+                 ctx->has_pushed_back = false;
                }
                | then_expr_list expression
                {
-                 if (!has_pushed_back)
-                   temp_expr_list->push_back($2);
-                 has_pushed_back = false;
+                 if (!ctx->has_pushed_back)
+                   ctx->temp_expr_list->push_back($2);
+                 ctx->has_pushed_back = false;
                }
                ;
 
 else_expr_list : ELSE expression
                {
-                 temp_expr_list = new std::vector<Expression *>;
-                 $$ = temp_expr_list;
-                 if (!has_pushed_back)
+                 ctx->temp_expr_list = new_expr_list();
+                 $$ = ctx->temp_expr_list;
+                 if (!ctx->has_pushed_back)
                    $$->push_back($2);
-                 has_pushed_back = false;
+                 ctx->has_pushed_back = false;
                }
                | else_expr_list expression
                {
-                 if (!has_pushed_back)
-                   temp_expr_list->push_back($2);
-                 has_pushed_back = false;
+                 if (!ctx->has_pushed_back)
+                   ctx->temp_expr_list->push_back($2);
+                 ctx->has_pushed_back = false;
                }
                ;
 
@@ -402,7 +408,7 @@ cond_expr : predictor_expr then_expr_list else_expr_list ENDIF
           }
           | error ENDIF
           {
-            yyerror("Error in conditional expression", yylloc);
+            yyerror(ctx, "Error in conditional expression", yylloc, yychar, yylval);
             yyerrok;
           }
           ;
@@ -449,30 +455,30 @@ arith_op : '+'
 
 io_expr : ASK expression AS identifier
         {
-          std::vector<Expression *> *args = new std::vector<Expression *>;
-          if (!has_pushed_back)
+          Expression_List *args = new_expr_list();
+          if (!ctx->has_pushed_back)
             args->push_back($2);
           else {
-            args->push_back(temp_return_id);
-            has_pushed_back = false;
+            args->push_back(ctx->temp_return_id);
+            ctx->has_pushed_back = false;
           }
           Direct_Call_Expr *call_expr = new Direct_Call_Expr(new Nil_Identifier(@2), id_tab->add_string("ask_with_prompt"), args, $4, @4);
           $$ = call_expr;
         }
         | ASK AS identifier
         {
-          std::vector<Expression *> *args = new std::vector<Expression *>;
+          Expression_List *args = new_expr_list();
           Direct_Call_Expr *call_expr = new Direct_Call_Expr(new Nil_Identifier(@2), id_tab->add_string("ask"), args, $3, @3);
           $$ = call_expr;
         }
         | SAY '(' expression ')'
         {
-          std::vector<Expression *> *args = new std::vector<Expression *>;
-          if (!has_pushed_back)
+          Expression_List *args = new_expr_list();
+          if (!ctx->has_pushed_back)
             args->push_back($3);
           else {
-            args->push_back(temp_return_id);
-            has_pushed_back = false;
+            args->push_back(ctx->temp_return_id);
+            ctx->has_pushed_back = false;
           }
           Direct_Call_Expr *call_expr = new Direct_Call_Expr(new Nil_Identifier(@3), id_tab->add_string("say"), args, new Nil_Identifier(@3), @3);
           $$ = call_expr;
@@ -481,61 +487,66 @@ io_expr : ASK expression AS identifier
 
 %%
 
-void yywarn(const char *s, YYLTYPE loc) {
-  std::cerr << input_filename << ":" << loc.first_line << ":" << loc.first_column
-            << ": Warning: " << s;
-  std::cerr << std::endl;
-  syntax_warn_count++;
+void yywarn(Compile_Context *ctx, const char *s, YYLTYPE loc) {
+  *ctx->diag << ctx->input_filename << ":" << loc.first_line << ":"
+             << loc.first_column << ": Warning: " << s;
+  *ctx->diag << std::endl;
+  ctx->syntax_warn_count++;
 }
 
-void yyerror(const char *s) {
-  yyerror(s, yylloc);
+// Called by the parser itself, the offending token is the last one lexed
+void yyerror(YYLTYPE *loc, yyscan_t scanner, Compile_Context *ctx,
+             const char *s) {
+  yyerror(ctx, s, *loc, ctx->last_token, ctx->last_lval);
 }
 
-void yyerror(const char *s, YYLTYPE loc) {
-  std::cerr << input_filename << ":" << loc.first_line << ":" << loc.first_column
-            << ": " << s << " at or near ";
-  print_token(yychar);
-  std::cerr << std::endl;
-  syntax_error_count++;
+void yyerror(Compile_Context *ctx, const char *s, YYLTYPE loc, int tok,
+             const YYSTYPE &lval) {
+  *ctx->diag << ctx->input_filename << ":" << loc.first_line << ":"
+             << loc.first_column << ": " << s << " at or near ";
+  print_token(*ctx->diag, tok, lval);
+  *ctx->diag << std::endl;
+  ctx->syntax_error_count++;
 }
 
-void parse_funcs(Identifier *caller) {
+void parse_funcs(Compile_Context *ctx, Identifier *caller, YYLTYPE loc) {
+  std::vector<Call_Expr *> &temp_call_list = ctx->temp_call_list;
+
   // dummy_chain_call_list collects call_expr in inverse order.
-  for (size_t i = temp_call_list->size(); i > 0; i--) {
-    Call_Expr *expr = temp_call_list->at(i - 1);
+  for (size_t i = temp_call_list.size(); i > 0; i--) {
+    Call_Expr *expr = temp_call_list.at(i - 1);
     if (expr->is_cond_call()) { // This expr is a function call with condition
       Cond_Call_Expr *cond_call_expr = static_cast<Cond_Call_Expr *>(expr);
       Direct_Call_Expr *direct_expr = cond_call_expr->call_expr;
 
       // Pass previous call's return_id to current call's id
-      direct_expr->id = (i == temp_call_list->size() ? caller : temp_return_id);
+      direct_expr->id = (i == temp_call_list.size() ? caller : ctx->temp_return_id);
 
       // Check owner and property relationship
       if (!has_same_owner(direct_expr->id, direct_expr->return_id))
-        yywarn("Should not store result value of a function called by a property in another property belongs to another variable!", yylloc);
+        yywarn(ctx, "Should not store result value of a function called by a property in another property belongs to another variable!", loc);
 
       direct_expr->return_id = adjust_return_id(direct_expr->id, direct_expr->return_id);
-      temp_return_id = direct_expr->return_id;
+      ctx->temp_return_id = direct_expr->return_id;
 
       // Convert Cond_Call_Expr to Cond_Expr
-      auto then_list = new std::vector<Expression *>;
+      auto then_list = new_expr_list();
       then_list->push_back(direct_expr);
-      global_expr_list->push_back(new Cond_Expr(cond_call_expr->predictor, then_list, cond_call_expr->location));
+      ctx->global_expr_list->push_back(new Cond_Expr(cond_call_expr->predictor, then_list, cond_call_expr->location));
     } else {
       Direct_Call_Expr *direct_expr = static_cast<Direct_Call_Expr *>(expr);
 
       // Pass previous call's return_id to current call's id
-      direct_expr->id = (i == temp_call_list->size() ? caller : temp_return_id);
+      direct_expr->id = (i == temp_call_list.size() ? caller : ctx->temp_return_id);
 
       // Check owner and property relationship
       if (!has_same_owner(direct_expr->id, direct_expr->return_id))
-      yywarn("Should not store result value of a function called by a property in another property belongs to another variable!", yylloc);
+      yywarn(ctx, "Should not store result value of a function called by a property in another property belongs to another variable!", loc);
 
       direct_expr->return_id = adjust_return_id(direct_expr->id, direct_expr->return_id);
-      temp_return_id = direct_expr->return_id;
-      global_expr_list->push_back(direct_expr);
+      ctx->temp_return_id = direct_expr->return_id;
+      ctx->global_expr_list->push_back(direct_expr);
     }
   }
-  has_pushed_back = true;
+  ctx->has_pushed_back = true;
 }
\ No newline at end of file
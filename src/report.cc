@@ -0,0 +1,152 @@
+/*
+  Saytring Compiler. A compiler translating Saytring to Python.
+  Copyright (C) 2024 Haoyuan Li
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "report.h"
+#include "AST.h"
+#include <cxxabi.h>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sys/resource.h>
+#include <typeindex>
+
+// VmHWM belongs to the address space of the process, while ru_maxrss may
+// still hold the peak of the parent that forked it
+long peak_rss() {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line))
+    if (line.compare(0, 6, "VmHWM:") == 0)
+      return atol(line.c_str() + 6) * 1024L; // in kB
+
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return -1;
+  return usage.ru_maxrss * 1024L; // in KiB
+}
+
+void Time_Report::lap(const char *name) {
+  clock::time_point now = clock::now();
+  phases.push_back(
+      {name, std::chrono::duration<double>(now - phase_start).count(),
+       peak_rss()});
+  phase_start = now;
+}
+
+double Time_Report::total() const {
+  double total = 0;
+  for (const Phase &phase : phases)
+    total += phase.seconds;
+  return total;
+}
+
+void Time_Report::print(std::ostream &out, bool json) const {
+  double total = this->total();
+  std::ios::fmtflags flags = out.flags();
+  std::streamsize precision = out.precision();
+
+  if (json) {
+    out << "{\"time_report\": {\"phases\": [";
+    for (size_t i = 0; i < phases.size(); i++)
+      out << (i ? ", " : "") << "{\"phase\": \"" << phases[i].name
+          << "\", \"seconds\": " << std::fixed << std::setprecision(9)
+          << phases[i].seconds << ", \"peak_rss\": " << phases[i].peak_rss
+          << "}";
+    out << "], \"total_seconds\": " << total << "}}" << std::endl;
+  } else {
+    out << "\nTime report:\n";
+    for (const Phase &phase : phases)
+      out << "  " << std::left << std::setw(24) << phase.name << std::right
+          << std::fixed << std::setprecision(3) << std::setw(10)
+          << phase.seconds * 1000 << " ms" << std::setw(8)
+          << std::setprecision(1)
+          << (total > 0 ? phase.seconds * 100 / total : 0) << "%"
+          << std::setw(10) << phase.peak_rss / 1024 << " KiB peak RSS\n";
+    out << "  " << std::left << std::setw(24) << "total" << std::right
+        << std::fixed << std::setprecision(3) << std::setw(10)
+        << total * 1000 << " ms" << std::endl;
+  }
+  out.flags(flags);
+  out.precision(precision);
+}
+
+void Mem_Report::add(const std::string &section, const std::string &name,
+                     long count, long bytes) {
+  entries.push_back({section, name, count, bytes});
+}
+
+void Mem_Report::add_ast_nodes(const std::vector<AST_Node *> &nodes) {
+  std::map<std::type_index, long> counts;
+  for (AST_Node *node : nodes)
+    counts[std::type_index(typeid(*node))]++;
+
+  // Sorted by class name rather than by type_info address
+  std::map<std::string, long> by_name;
+  for (const auto &[type, count] : counts) {
+    int status;
+    char *name = abi::__cxa_demangle(type.name(), nullptr, nullptr, &status);
+    by_name[status == 0 ? name : type.name()] = count;
+    free(name);
+  }
+  for (const auto &[name, count] : by_name)
+    add("AST nodes", name, count);
+  add("AST nodes", "total", nodes.size());
+}
+
+void Mem_Report::add_peak_rss() {
+  add("process", "peak RSS", -1, peak_rss());
+}
+
+// JSON strings here are class and table names, nothing to escape
+void Mem_Report::print(std::ostream &out, bool json) const {
+  if (json) {
+    out << "{\"mem_report\": [";
+    for (size_t i = 0; i < entries.size(); i++) {
+      const Entry &e = entries[i];
+      out << (i ? ", " : "") << "{\"section\": \"" << e.section
+          << "\", \"name\": \"" << e.name << "\"";
+      if (e.count >= 0)
+        out << ", \"count\": " << e.count;
+      if (e.bytes >= 0)
+        out << ", \"bytes\": " << e.bytes;
+      out << "}";
+    }
+    out << "]}" << std::endl;
+    return;
+  }
+
+  std::ios::fmtflags flags = out.flags();
+  out << "\nMemory report:";
+  const std::string *section = nullptr;
+  for (const Entry &e : entries) {
+    if (!section || *section != e.section) {
+      section = &e.section;
+      out << "\n  " << e.section << ":\n";
+    }
+    out << "    " << std::left << std::setw(28) << e.name << std::right;
+    if (e.count >= 0)
+      out << std::setw(10) << e.count;
+    else
+      out << std::setw(10) << "";
+    if (e.bytes >= 0)
+      out << std::setw(14) << e.bytes << " bytes";
+    out << "\n";
+  }
+  out << std::flush;
+  out.flags(flags);
+}
@@ -0,0 +1,249 @@
+/*
+  Saytring Compiler. A compiler translating Saytring to Python.
+  Copyright (C) 2024 Haoyuan Li
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "runtime.h"
+#include "cgen.h"
+#include "sink.h"
+#include "template.h"
+#include "util.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace fs = std::filesystem;
+
+static bool is_name_start(char c) {
+  return isalpha((unsigned char)c) || c == '_';
+}
+static bool is_name_char(char c) {
+  return isalnum((unsigned char)c) || c == '_';
+}
+
+// The name defined by a top-level line: "def name", "class name",
+// "name = ..." or "name: type = ...". Empty for anything else.
+static std::string_view defined_name(std::string_view line) {
+  for (std::string_view keyword : {"def ", "class "})
+    if (line.substr(0, keyword.size()) == keyword) {
+      line.remove_prefix(keyword.size());
+      while (!line.empty() && line[0] == ' ')
+        line.remove_prefix(1);
+      size_t n = 0;
+      while (n < line.size() && is_name_char(line[n]))
+        n++;
+      return line.substr(0, n);
+    }
+
+  if (line.empty() || !is_name_start(line[0]))
+    return {};
+  size_t n = 0;
+  while (n < line.size() && is_name_char(line[n]))
+    n++;
+  size_t i = n;
+  while (i < line.size() && line[i] == ' ')
+    i++;
+  if (i < line.size() &&
+      (line[i] == ':' || (line[i] == '=' && line.substr(i, 2) != "==")))
+    return line.substr(0, n);
+  return {};
+}
+
+bool Runtime::load(const char *runtime_filename) {
+  if (!load_runtime(runtime_filename, text))
+    return false;
+  if (target == TARGET_PYTHON)
+    split();
+  return true;
+}
+
+// A definition starts at a line beginning in the first column, unless it
+// closes a bracket or is inside a triple-quoted string. Comment and
+// decorator lines start the definition that follows them.
+void Runtime::split() {
+  definitions.clear();
+  names.clear();
+  bool in_string = false;
+  bool has_code = false; // the current definition has more than comments
+  size_t pos = 0;
+  while (pos < text.size()) {
+    size_t eol = text.find('\n', pos);
+    size_t next = eol == std::string::npos ? text.size() : eol + 1;
+    std::string_view line(text.data() + pos, next - pos);
+
+    char c = line[0];
+    bool top = !in_string && !isspace((unsigned char)c) && c != ')' &&
+               c != ']' && c != '}';
+    bool comment = c == '#' || c == '@';
+    if (definitions.empty() || (top && has_code)) {
+      if (!definitions.empty())
+        definitions.back().end = pos;
+      definitions.push_back({pos, text.size(), {}, {}});
+      has_code = false;
+    }
+    if (top && !comment) {
+      has_code = true;
+      std::string_view name = defined_name(line);
+      if (!name.empty() && definitions.back().name.empty()) {
+        definitions.back().name = name;
+        names[std::string(name)] = definitions.size() - 1;
+      }
+    }
+
+    for (size_t quote = line.find("\"\"\""); quote != std::string::npos;
+         quote = line.find("\"\"\"", quote + 3))
+      in_string = !in_string;
+    pos = next;
+  }
+
+  // Every name of a known definition in the text of another one
+  for (size_t i = 0; i < definitions.size(); i++) {
+    Definition &def = definitions[i];
+    size_t p = def.begin;
+    while (p < def.end) {
+      if (!is_name_start(text[p]) ||
+          (p > def.begin && is_name_char(text[p - 1]))) {
+        p++;
+        continue;
+      }
+      size_t q = p;
+      while (q < def.end && is_name_char(text[q]))
+        q++;
+      size_t used = find(std::string_view(text.data() + p, q - p));
+      if (used != size() && used != i &&
+          std::find(def.uses.begin(), def.uses.end(), used) == def.uses.end())
+        def.uses.push_back(used);
+      p = q;
+    }
+  }
+}
+
+size_t Runtime::find(std::string_view name) const {
+  auto it = names.find(name);
+  return it == names.end() ? size() : it->second;
+}
+
+void Runtime::write(Code_Sink &out, const Runtime_Refs &refs) const {
+  if (mode == RUNTIME_FULL || target == TARGET_CPP) {
+    out.append(text.data(), text.size());
+    return;
+  }
+  if (mode == RUNTIME_MODULE) {
+    write_import(out, refs);
+    return;
+  }
+
+  std::vector<char> kept(size(), 0);
+  std::vector<size_t> pending;
+  for (size_t i = 0; i < size(); i++)
+    if (definitions[i].name.empty() || refs.uses(i)) {
+      kept[i] = 1;
+      pending.push_back(i);
+    }
+  while (!pending.empty()) {
+    size_t i = pending.back();
+    pending.pop_back();
+    for (size_t used : definitions[i].uses)
+      if (!kept[used]) {
+        kept[used] = 1;
+        pending.push_back(used);
+      }
+  }
+
+  for (size_t i = 0; i < size(); i++)
+    if (kept[i])
+      out.append(text.data() + definitions[i].begin,
+                 definitions[i].end - definitions[i].begin);
+}
+
+// Only the names the program refers to itself, the package takes care of
+// the rest
+void Runtime::write_import(Code_Sink &out, const Runtime_Refs &refs) const {
+  std::string version = this->version();
+  emit<runtime_import_template>(
+      out, RUNTIME_MODULE_NAME, std::string_view(version),
+      [this, &refs](Code_Sink &out) {
+        bool first = true;
+        for (size_t i = 0; i < size(); i++)
+          if (refs.uses(i) && !definitions[i].name.empty()) {
+            if (!first)
+              out += ", ";
+            first = false;
+            out.append(definitions[i].name.data(),
+                       definitions[i].name.size());
+          }
+        if (first)
+          out += "SaytringVar";
+      });
+}
+
+std::string Runtime::version() const {
+  char hash[16];
+  snprintf(hash, sizeof(hash), "%08x", hash_string(text.data(), text.size()));
+  return std::string(_VERSION_) + "+" + hash;
+}
+
+bool Runtime::install(const std::string &dir) const {
+  std::error_code ec;
+  fs::path package = fs::path(dir) / RUNTIME_MODULE_NAME;
+  if (!fs::is_directory(package, ec) && !fs::create_directories(package, ec)) {
+    std::cerr << "Error: Unable to create directory: " << package.string()
+              << std::endl;
+    return false;
+  }
+
+  fs::path init = package / "__init__.py";
+  std::ofstream file(init, std::ios::binary | std::ios::trunc);
+  file << text;
+  if (!text.empty() && text.back() != '\n')
+    file << '\n';
+  file << "\n__version__ = \"" << version() << "\"\n";
+  file.close();
+  if (!file) {
+    std::cerr << "Unable to write file: " << init.string() << std::endl;
+    return false;
+  }
+  return true;
+}
+
+void Runtime_Refs::add(std::string_view name) {
+  size_t definition = runtime.find(name);
+  if (definition != runtime.size())
+    used[definition] = 1;
+}
+
+void Runtime_Refs::add(Symbol *owner, Symbol *name) {
+  std::string variable(owner->get_string(), owner->get_len());
+  variable += '_';
+  variable.append(name->get_string(), name->get_len());
+  add(variable);
+}
+
+void Runtime_Refs::add_variable(Symbol *name) {
+  if (runtime.get_target() == TARGET_CPP)
+    variables.emplace(name->get_string(), name->get_len());
+}
+
+void Runtime_Refs::add_variable(Symbol *owner, Symbol *name) {
+  if (runtime.get_target() != TARGET_CPP)
+    return;
+  std::string variable(owner->get_string(), owner->get_len());
+  variable += '_';
+  variable.append(name->get_string(), name->get_len());
+  variables.insert(std::move(variable));
+}
@@ -0,0 +1,179 @@
+/*
+  Saytring Compiler. A compiler translating Saytring to Python.
+  Copyright (C) 2024 Haoyuan Li
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "server.h"
+#include "context.h"
+#include "core_func.h"
+#include "source.h"
+#include "util.h"
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// Send all of data, without raising SIGPIPE if the client went away
+static bool send_all(int fd, const char *data, size_t size) {
+  while (size > 0) {
+    ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+    if (n < 0)
+      return false;
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+static bool recv_all(int fd, char *data, size_t size) {
+  while (size > 0) {
+    ssize_t n = recv(fd, data, size, 0);
+    if (n <= 0)
+      return false;
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+// Read up to and excluding the next '\n'. Headers are short, so reading
+// byte by byte keeps the source bytes that follow in the socket.
+static bool recv_line(int fd, std::string &line) {
+  line.clear();
+  char c;
+  while (recv(fd, &c, 1, 0) == 1) {
+    if (c == '\n')
+      return true;
+    line.push_back(c);
+  }
+  return false;
+}
+
+Compile_Server::~Compile_Server() {
+  if (listen_fd >= 0) {
+    close(listen_fd);
+    unlink(socket_path.c_str());
+  }
+}
+
+bool Compile_Server::load_runtime(const char *runtime_filename,
+                                  Runtime_Mode mode) {
+  runtime.set_mode(mode);
+  return runtime.load(runtime_filename);
+}
+
+bool Compile_Server::listen() {
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (socket_path.size() >= sizeof(addr.sun_path)) {
+    std::cerr << "Error: Socket path too long: " << socket_path << std::endl;
+    return false;
+  }
+  strcpy(addr.sun_path, socket_path.c_str());
+
+  listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listen_fd < 0) {
+    perror("Failed to create socket");
+    return false;
+  }
+  unlink(socket_path.c_str());
+  if (::bind(listen_fd, (sockaddr *)&addr, sizeof(addr)) < 0 ||
+      ::listen(listen_fd, SOMAXCONN) < 0) {
+    perror("Failed to listen on socket");
+    close(listen_fd);
+    listen_fd = -1;
+    return false;
+  }
+
+  // Warm everything shared by the requests up front
+  install_type_cast_map();
+  install_buildin_func();
+  return true;
+}
+
+void Compile_Server::serve() {
+  for (;;) {
+    int fd = accept(listen_fd, nullptr, nullptr);
+    if (fd < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("Failed to accept connection");
+      return;
+    }
+    std::thread(&Compile_Server::serve_connection, this, fd).detach();
+  }
+}
+
+void Compile_Server::serve_connection(int fd) {
+  std::string header;
+  while (recv_line(fd, header))
+    if (!handle_request(fd, header))
+      break;
+  close(fd);
+}
+
+// Return false if the connection cannot be used any more
+bool Compile_Server::handle_request(int fd, const std::string &header) {
+  char name[256];
+  unsigned long long size;
+  int digits = 0;
+  // %llu would take "-1" too
+  if (sscanf(header.c_str(), "%255s %n%llu", name, &digits, &size) != 2 ||
+      !isdigit((unsigned char)header[digits])) {
+    std::string reply = "error 0 0\n";
+    send_all(fd, reply.c_str(), reply.size());
+    return false;
+  }
+  // The source is not read, so the connection is out of step from here
+  if (size > SERVER_MAX_SOURCE) {
+    std::string diagnostics = std::string(name) + ": The input is larger than " +
+                              std::to_string(SERVER_MAX_SOURCE) + " bytes.\n";
+    std::string reply = "error " + std::to_string(diagnostics.size()) + " 0\n";
+    send_all(fd, reply.c_str(), reply.size());
+    send_all(fd, diagnostics.c_str(), diagnostics.size());
+    return false;
+  }
+
+  // The lexer scans the buffer in place and needs the sentinels after it
+  std::vector<char> source(size + SOURCE_SENTINELS, '\0');
+  if (!recv_all(fd, source.data(), size))
+    return false;
+
+  std::ostringstream diag;
+  std::string code;
+  Compile_Context ctx(name, &diag);
+  ctx.own_symbols();
+  bool compiled = ctx.check(source.data(), size);
+  if (compiled) {
+    Code_Sink out(code);
+    ctx.generate(out, runtime);
+  }
+
+  std::string diagnostics = diag.str();
+  std::string reply = std::string(compiled ? "ok " : "error ") +
+                      std::to_string(diagnostics.size()) + " " +
+                      std::to_string(code.size()) + "\n";
+  return send_all(fd, reply.c_str(), reply.size()) &&
+         send_all(fd, diagnostics.c_str(), diagnostics.size()) &&
+         send_all(fd, code.c_str(), code.size());
+}
@@ -0,0 +1,96 @@
+/*
+  Saytring Compiler. A compiler translating Saytring to Python.
+  Copyright (C) 2024 Haoyuan Li
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "sink.h"
+#include "template.h"
+#include <cerrno>
+#include <unistd.h>
+
+Code_Sink::Code_Sink(int fd)
+    : fd(fd), str(nullptr), buffer(new char[SINK_BUFFER_SIZE]), used(0),
+      total(0), failed(false), depth(0), line_start(true) {}
+
+Code_Sink::Code_Sink(std::string &str)
+    : fd(-1), str(&str), buffer(nullptr), used(0), total(0), failed(false),
+      depth(0), line_start(true) {}
+
+Code_Sink::~Code_Sink() {
+  flush();
+  delete[] buffer;
+}
+
+void Code_Sink::write_indent() {
+  for (int i = 0; i < depth; i++)
+    put(INTEND, sizeof(INTEND) - 1);
+}
+
+static bool write_all(int fd, const char *s, size_t len) {
+  while (len > 0) {
+    ssize_t n = write(fd, s, len);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    s += n;
+    len -= n;
+  }
+  return true;
+}
+
+// Too large for what is left of the buffer
+void Code_Sink::write_through(const char *s, size_t len) {
+  flush();
+  if (len < SINK_BUFFER_SIZE) {
+    memcpy(buffer, s, len);
+    used = len;
+  } else if (!failed && !write_all(fd, s, len)) {
+    failed = true;
+  }
+}
+
+bool Code_Sink::copy_from(int in_fd) {
+  if (!buffer) {
+    char chunk[SINK_BUFFER_SIZE / 4];
+    ssize_t n;
+    while ((n = read(in_fd, chunk, sizeof(chunk))) > 0)
+      append(chunk, n);
+    return n == 0;
+  }
+
+  // Read straight into the free part of the buffer
+  for (;;) {
+    if (used == SINK_BUFFER_SIZE)
+      flush();
+    ssize_t n = read(in_fd, buffer + used, SINK_BUFFER_SIZE - used);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return n == 0;
+    used += n;
+    total += n;
+  }
+}
+
+bool Code_Sink::flush() {
+  if (buffer && used > 0) {
+    if (!failed && !write_all(fd, buffer, used))
+      failed = true;
+    used = 0;
+  }
+  return !failed;
+}
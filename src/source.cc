@@ -0,0 +1,104 @@
+/*
+  Saytring Compiler. A compiler translating Saytring to Python.
+  Copyright (C) 2024 Haoyuan Li
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "source.h"
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SOURCE_READ_CHUNK (64 * 1024)
+
+bool Source_File::open(const char *filename) {
+  close();
+  int fd = STDIN_FILENO;
+  if (strcmp(filename, "<stdin>") != 0 && (fd = ::open(filename, O_RDONLY)) < 0)
+    return false;
+
+  struct stat st;
+  bool ok;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+    ok = open_mapped(fd, st.st_size);
+  else
+    ok = open_stream(fd);
+  if (fd != STDIN_FILENO)
+    ::close(fd);
+  return ok;
+}
+
+bool Source_File::open_mapped(int fd, size_t file_size) {
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t len = (file_size + SOURCE_SENTINELS + page - 1) & ~(page - 1);
+
+  // Reserve zero-filled pages first, then map the file over their head: the
+  // sentinels come for free even when the file ends on a page boundary.
+  void *p = mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED)
+    return false;
+  if (file_size > 0 &&
+      mmap(p, file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd,
+           0) == MAP_FAILED) {
+    munmap(p, len);
+    return false;
+  }
+  base = (char *)p;
+  size = file_size;
+  mapped_len = len;
+  return true;
+}
+
+bool Source_File::open_stream(int fd) {
+  size_t capacity = SOURCE_READ_CHUNK;
+  char *buf = (char *)malloc(capacity);
+  size_t n = 0;
+  ssize_t got;
+
+  while (buf != nullptr) {
+    if (n + SOURCE_READ_CHUNK + SOURCE_SENTINELS > capacity) {
+      capacity *= 2;
+      char *bigger = (char *)realloc(buf, capacity);
+      if (bigger == nullptr)
+        break;
+      buf = bigger;
+    }
+    if ((got = read(fd, buf + n, SOURCE_READ_CHUNK)) <= 0) {
+      if (got < 0)
+        break;
+      memset(buf + n, 0, SOURCE_SENTINELS);
+      base = buf;
+      size = n;
+      return true;
+    }
+    n += got;
+  }
+  free(buf);
+  return false;
+}
+
+void Source_File::close() {
+  if (base == nullptr)
+    return;
+  if (mapped_len > 0)
+    munmap(base, mapped_len);
+  else
+    free(base);
+  base = nullptr;
+  size = mapped_len = 0;
+}
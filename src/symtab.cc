@@ -18,33 +18,101 @@
 #include "symtab.h"
 #include <cstring>
 
+#define STR_TAB_INIT_CAPACITY 256
+
+unsigned int hash_string(const char *s, size_t len) {
+  unsigned int h = 2166136261u;
+  for (size_t i = 0; i < len; i++) {
+    h ^= (unsigned char)s[i];
+    h *= 16777619u;
+  }
+  return h;
+}
+
 Symbol::Symbol(char *s) {
-  int len =
-      (int)strlen(s); // store length of string without '\0', help to add '\0'
+  // store length of string without '\0', help to add '\0'
+  len = strlen(s);
   str = new char[len + 1];
-  strncpy(str, s, len);
-  str[len] = '\0';
+  memcpy(str, s, len + 1);
+  hash = hash_string(str, len);
 }
 
-bool Symbol::operator==(Symbol other) {
-  return std::strcmp(str, other.str) == 0;
+Symbol::Symbol(char *str, size_t len, unsigned int hash) {
+  this->str = str;
+  this->len = len;
+  this->hash = hash;
 }
 
-Symbol *String_Tab::add_string(char *s) {
-  Symbol *new_sym = new Symbol(s);
-  for (Symbol *sym : *symtab) {
-    if (*new_sym == *sym) { // If find same symbol, return it
-      delete new_sym;
+bool Symbol::operator==(const Symbol &other) const {
+  return hash == other.hash && len == other.len &&
+         std::memcmp(str, other.str, len) == 0;
+}
+
+String_Tab::String_Tab(String_Tab *shared) {
+  capacity = STR_TAB_INIT_CAPACITY;
+  count = 0;
+  slots = new Symbol *[capacity]();
+  this->shared = shared;
+}
+
+// Double the table and reinsert every symbol, keeping the Symbol* stable
+void String_Tab::grow() {
+  size_t old_capacity = capacity;
+  Symbol **old_slots = slots;
+
+  capacity *= 2;
+  slots = new Symbol *[capacity]();
+  for (size_t i = 0; i < old_capacity; i++) {
+    if (old_slots[i] == nullptr)
+      continue;
+    size_t pos = old_slots[i]->get_hash() & (capacity - 1);
+    while (slots[pos] != nullptr)
+      pos = (pos + 1) & (capacity - 1);
+    slots[pos] = old_slots[i];
+  }
+  delete[] old_slots;
+}
+
+Symbol *String_Tab::add_string(char *s) { return add_string(s, strlen(s)); }
+
+// The symbol of s, or nullptr and the free slot for it at pos. The caller
+// holds lock.
+Symbol *String_Tab::find(const char *s, size_t len, unsigned int hash,
+                         size_t &pos) {
+  pos = hash & (capacity - 1);
+  while (Symbol *sym = slots[pos]) {
+    if (sym->get_hash() == hash && sym->get_len() == len &&
+        std::memcmp(sym->get_string(), s, len) == 0)
+      return sym; // If find same symbol, return it
+    pos = (pos + 1) & (capacity - 1);
+  }
+  return nullptr;
+}
+
+Symbol *String_Tab::add_string(const char *s, size_t len) {
+  unsigned int hash = hash_string(s, len);
+  size_t pos;
+  if (shared) {
+    std::lock_guard<std::mutex> guard(shared->lock);
+    if (Symbol *sym = shared->find(s, len, hash, pos))
       return sym;
-    }
   }
-  this->symtab->push_back(new_sym);
+  std::lock_guard<std::mutex> guard(lock);
+  if (Symbol *sym = find(s, len, hash, pos))
+    return sym;
+
+  Symbol *new_sym = new (arena) Symbol(arena.copy_string(s, len), len, hash);
+  slots[pos] = new_sym;
+  // Keep load factor under 1/2
+  if (++count * 2 > capacity)
+    grow();
   return new_sym;
 }
 
-String_Tab *id_tab = new String_Tab();
-String_Tab *str_tab = new String_Tab();
-String_Tab *int_tab = new String_Tab();
+String_Tab shared_id_tab, shared_str_tab, shared_int_tab;
+thread_local String_Tab *id_tab = &shared_id_tab;
+thread_local String_Tab *str_tab = &shared_str_tab;
+thread_local String_Tab *int_tab = &shared_int_tab;
 
 Symbol *_string = id_tab->add_string("_string");
 Symbol *_int = id_tab->add_string("_int");
@@ -53,6 +121,7 @@ Symbol *_bool = id_tab->add_string("_bool");
 Symbol *NULL_Type = id_tab->add_string("NULL_Type");
 Symbol *ERR_Type = id_tab->add_string("ERR_Type");
 Symbol *LAST_RESULT = id_tab->add_string("last_result");
+Symbol *RECORD = id_tab->add_string("record");
 
 Symbol *_ADD = new Symbol("ADD");
 Symbol *_SUB = new Symbol("SUB");
@@ -20,9 +20,11 @@
 #include "parser.tab.h"
 #include "symtab.h"
 #include <ctype.h>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <map>
+#include <sstream>
 
 std::map<int, const char *> token_map = {{0, "EOF"},
                                          {DEFINE, "DEFINE"},
@@ -103,29 +105,29 @@ void print_escaped_string(ostream &str, const char *s) {
     s++;
   }
 }
-void print_token(int tok) {
+void print_token(ostream &str, int tok, const YYSTYPE &lval) {
 
-  cerr << token_to_string(tok);
+  str << token_to_string(tok);
 
   switch (tok) {
   case (STR_CONST):
-    cerr << " = ";
-    cerr << " \"";
-    print_escaped_string(cerr, yylval.symbol->get_string());
-    cerr << "\"";
+    str << " = ";
+    str << " \"";
+    print_escaped_string(str, lval.symbol->get_string());
+    str << "\"";
     break;
   case (INT_CONST):
-    cerr << " = " << yylval.symbol->get_string();
+    str << " = " << lval.symbol->get_string();
     break;
   case (BOOL_CONST):
-    cerr << (yylval.bool_val ? " = true" : " = false");
+    str << (lval.bool_val ? " = true" : " = false");
     break;
   case (ID):
-    cerr << " = " << yylval.symbol->get_string();
+    str << " = " << lval.symbol->get_string();
     break;
   case (ERROR):
-    cerr << " = ";
-    print_escaped_string(cerr, yylval.error_msg);
+    str << " = ";
+    print_escaped_string(str, lval.error_msg);
     break;
   }
 }
@@ -170,3 +172,16 @@ Owner_Identifier *adjust_return_id(Identifier *id) {
     return new Owner_Identifier(sing_id->name, LAST_RESULT, sing_id->location);
   }
 }
+
+bool load_runtime(const char *runtime_filename, std::string &runtime) {
+  std::ifstream runtime_file(runtime_filename);
+  if (!runtime_file.is_open()) {
+    std::cerr << "Error: Missing runtime file: " << runtime_filename
+              << std::endl;
+    return false;
+  }
+  std::ostringstream buf;
+  buf << runtime_file.rdbuf();
+  runtime = buf.str();
+  return true;
+}
@@ -0,0 +1,543 @@
+/*
+  Saytring Compiler. A compiler translating Saytring to Python.
+  Copyright (C) 2024 Haoyuan Li
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "vm.h"
+#include "AST.h"
+#include "cgen.h"
+#include "symtab.h"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Lowering of the checked and optimized AST to the bytecode of vm.h. It
+// follows cgen.cc expression by expression: the instructions do what the
+// Python code does, in the same order, with the functions of runtime.py
+// ported to runtime/runtime.h. The VM runs them in vm_exec.cc.
+
+extern Symbol *_string, *_int, *_bool, *NULL_Type, *_list;
+
+// from core_func.cc
+extern std::map<std::pair<Symbol *, Symbol *>, std::string> *type_cast_map;
+
+const char *const vm_operand_kinds[OP_COUNT] = {
+#define VM_CORE_OPERANDS(op, operands) #operands,
+#define VM_BUILTIN_OPERANDS(op, name, params) #params,
+    VM_CORE_OPS(VM_CORE_OPERANDS) VM_BUILTINS(VM_BUILTIN_OPERANDS)
+#undef VM_CORE_OPERANDS
+#undef VM_BUILTIN_OPERANDS
+};
+
+/*----------------------------------.
+|  VM_Builder                       |
+`----------------------------------*/
+
+int32_t VM_Builder::slot_of(std::string name) {
+  auto it = slots.find(name);
+  if (it != slots.end())
+    return it->second;
+  int32_t slot = (int32_t)program.slot_names.size();
+  slots.emplace(name, slot);
+  program.slot_names.push_back(std::move(name));
+  return slot;
+}
+
+// A property is the variable owner_name of the Python code
+int32_t VM_Builder::slot(Symbol *name) {
+  return slot_of(std::string(name->get_string(), name->get_len()));
+}
+
+int32_t VM_Builder::slot(Symbol *owner, Symbol *name) {
+  return slot_of(std::string(owner->get_string(), owner->get_len()) + "_" +
+                 std::string(name->get_string(), name->get_len()));
+}
+
+int32_t VM_Builder::constant(VM_Constant c, const std::string &key) {
+  auto it = constants.find(key);
+  if (it != constants.end())
+    return ~it->second;
+  c.reg = program.register_count++;
+  constants.emplace(key, c.reg);
+  program.constants.push_back(std::move(c));
+  return ~c.reg;
+}
+
+int32_t VM_Builder::int_constant(long long i) {
+  return constant({0, VM_Constant::INT, i, ""}, "i" + std::to_string(i));
+}
+
+int32_t VM_Builder::string_constant(const std::string &s) {
+  return constant({0, VM_Constant::STR, 0, s}, "s" + s);
+}
+
+int32_t VM_Builder::bool_constant(bool b) {
+  return constant({0, VM_Constant::BOOL, b, ""}, b ? "b1" : "b0");
+}
+
+int32_t VM_Builder::result_register() {
+  int32_t reg;
+  if (free_registers.empty()) {
+    reg = program.register_count++;
+  } else {
+    reg = free_registers.back();
+    free_registers.pop_back();
+  }
+  busy_registers.push_back(reg);
+  return ~reg;
+}
+
+size_t VM_Builder::emit(VM_Opcode op,
+                        std::initializer_list<int32_t> operands) {
+  size_t at = here();
+  program.code.push_back(op);
+  program.code.insert(program.code.end(), operands);
+  return at;
+}
+
+// The results of a statement are read by the statement only
+void VM_Builder::statement(Expression *expr) {
+  size_t busy = busy_registers.size();
+  expr->vm_compile(*this);
+  free_registers.insert(free_registers.end(), busy_registers.begin() + busy,
+                        busy_registers.end());
+  busy_registers.resize(busy);
+}
+
+static bool independent_records(const VM_Program &program);
+
+bool Program::vm_compile(VM_Program &out) {
+  VM_Builder b(out);
+  if (setup_list) {
+    for (Expression *expr : *setup_list)
+      b.statement(expr);
+    b.emit(OP_HALT);
+    out.record_slot = b.slot(RECORD);
+    out.body = (int32_t)b.here();
+    // record is defined anew for each record, its last_result along
+    b.emit(OP_CLEAR, {b.slot(RECORD, LAST_RESULT)});
+  }
+  for (Expression *expr : *expr_list)
+    b.statement(expr);
+  b.emit(OP_HALT);
+  if (setup_list)
+    out.independent = independent_records(out);
+  return !b.has_failed();
+}
+
+/*----------------------------------.
+|  Record independence              |
+`----------------------------------*/
+
+// Records are independent when no run can read what an earlier one
+// stored: then any of them can run on a copy of the variables as the setup
+// left them. It is decided on the bytecode, where each variable of
+// Env::id_map and property of Env::property_map is a slot, the ones the
+// runtime stores into for the AST (_anonymous) included.
+//
+// A slot is fresh where every path from the start of the run goes through
+// an instruction storing the whole of it: DECL, CLEAR, ASSIGN, SAVE, or a
+// built-in storing its result on every path. The others only store into it
+// when they do not skip. A run may only read a slot that is not fresh if
+// no run stores into it at all, as the constants of the setup. ask reads
+// stdin, in the order of the records.
+
+// The built-ins storing into their last operand even when they skip
+static const VM_Opcode full_stores[] = {
+    OP_CAST_INT_TO_STR, OP_CAST_INT_TO_BOOL, OP_CAST_STR_TO_INT,
+    OP_CAST_STR_TO_BOOL, OP_CAST_BOOL_TO_STR, OP_CAST_BOOL_TO_INT,
+    OP_CAST_LIST_TO_STR, OP_CAST_NULL_TO_STR, OP_CAST_NULL_TO_INT,
+    OP_CAST_NULL_TO_BOOL, OP_REPLACE, OP_FIND, OP_TRIM, OP_SPLIT,
+    OP_GET_AT};
+
+static bool independent_records(const VM_Program &program) {
+  const std::vector<int32_t> &code = program.code;
+  size_t slots = program.slot_names.size();
+  std::vector<bool> stored(slots, false), read_stale(slots, false);
+  std::vector<bool> fresh(slots, false);
+  fresh[program.record_slot] = true;
+  // The slots fresh on every jump to a position yet to come. Jumps only go
+  // forward.
+  std::unordered_map<size_t, std::vector<bool>> jumped;
+  auto jump = [&](size_t target) {
+    auto it = jumped.find(target);
+    if (it == jumped.end()) {
+      jumped.emplace(target, fresh);
+      return;
+    }
+    for (size_t s = 0; s < slots; s++)
+      it->second[s] = it->second[s] && fresh[s];
+  };
+  auto read = [&](int32_t operand) {
+    if (operand >= 0 && !fresh[operand])
+      read_stale[operand] = true;
+  };
+
+  bool reachable = true;
+  for (size_t pos = program.body; pos < code.size();) {
+    VM_Opcode op = (VM_Opcode)code[pos];
+    const int32_t *operands = &code[pos + 1];
+    const char *kinds = vm_operand_kinds[op];
+    size_t next = pos + 1 + strlen(kinds) + (op == OP_REUSE ? operands[3] : 0);
+    auto it = jumped.find(pos);
+    if (it != jumped.end()) {
+      for (size_t s = 0; s < slots; s++)
+        fresh[s] = it->second[s] && (fresh[s] || !reachable);
+      reachable = true;
+      jumped.erase(it);
+    }
+    if (!reachable) {
+      pos = next;
+      continue;
+    }
+
+    switch (op) {
+    case OP_ASK:
+    case OP_ASK_WITH_PROMPT:
+      return false;
+    case OP_DECL:
+    case OP_CLEAR:
+    case OP_ASSIGN:
+    case OP_SAVE:
+      // The type of DECL is no slot
+      for (size_t i = 1; kinds[i]; i++)
+        if (kinds[i] == 'A' || kinds[i] == 'V')
+          read(operands[i]);
+      stored[operands[0]] = fresh[operands[0]] = true;
+      break;
+    case OP_REUSE:
+      read(operands[0]);
+      for (int32_t i = 0; i < operands[3]; i++)
+        read(operands[4 + i]);
+      stored[operands[1]] = true;
+      jump(operands[2]);
+      break;
+    case OP_COMP:
+    case OP_ARITH:
+      read(operands[1]);
+      read(operands[2]);
+      break;
+    case OP_PRINT:
+      break;
+    case OP_JUMP:
+      jump(operands[0]);
+      reachable = false;
+      break;
+    case OP_JUMP_UNLESS:
+      read(operands[0]);
+      jump(operands[1]);
+      break;
+    case OP_HALT:
+      reachable = false;
+      break;
+    default: {
+      // A built-in reads its operands but the last variable, its result.
+      // Casts convert the first one in place as well.
+      size_t n = strlen(kinds);
+      bool has_result = kinds[n - 1] == 'V';
+      for (size_t i = 0; i < n - has_result; i++)
+        read(operands[i]);
+      if (op >= OP_CAST_INT_TO_STR && op <= OP_CAST_NULL_TO_BOOL)
+        stored[operands[0]] = true;
+      if (has_result) {
+        stored[operands[n - 1]] = true;
+        for (VM_Opcode full : full_stores)
+          if (op == full)
+            fresh[operands[n - 1]] = true;
+      }
+    }
+    }
+    pos = next;
+  }
+
+  for (size_t s = 0; s < slots; s++)
+    if (read_stale[s] && stored[s])
+      return false;
+  return true;
+}
+
+/*----------------------------------.
+|  Helpers                          |
+`----------------------------------*/
+
+// The opcode of a built-in of runtime.py and the params it takes
+struct VM_Builtin {
+  const char *name;
+  VM_Opcode op;
+  const char *params;
+};
+
+static const VM_Builtin vm_builtins[] = {
+#define VM_BUILTIN_ENTRY(op, name, params) {#name, OP_##op, #params},
+    VM_BUILTINS(VM_BUILTIN_ENTRY)
+#undef VM_BUILTIN_ENTRY
+};
+
+static const VM_Builtin *find_builtin(const char *name) {
+  for (const VM_Builtin &builtin : vm_builtins)
+    if (strcmp(builtin.name, name) == 0)
+      return &builtin;
+  return nullptr;
+}
+
+// Call builtin on operands, which have to be what it takes
+static void emit_builtin_call(VM_Builder &b, const VM_Builtin *builtin,
+                              const std::vector<int32_t> &operands) {
+  if (!builtin || operands.size() != strlen(builtin->params)) {
+    b.fail();
+    return;
+  }
+  for (size_t i = 0; i < operands.size(); i++)
+    if (operands[i] == VM_NO_VALUE ||
+        (builtin->params[i] == 'V' && operands[i] < 0)) {
+      b.fail();
+      return;
+    }
+  b.emit(builtin->op);
+  for (int32_t operand : operands)
+    b.append(operand);
+}
+
+// The order of Op in runtime/runtime.h
+static int32_t op_index(Symbol *op) {
+  static const char *ops[] = {"ADD", "SUB", "EQ", "NE",
+                              "LT",  "LE",  "GT", "GE"};
+  for (int32_t i = 0; i < 8; i++)
+    if (strcmp(op->get_string(), ops[i]) == 0)
+      return i;
+  return -1;
+}
+
+// The DataType of runtime/runtime.h
+static int32_t data_type(Symbol *type) {
+  if (type == _string)
+    return 2;
+  if (type == _int)
+    return 1;
+  if (type == _bool)
+    return 3;
+  return 5;
+}
+
+static void vm_branch(VM_Builder &b, Expression_List *list) {
+  for (Expression *expr : *list)
+    b.statement(expr);
+}
+
+static int32_t vm_operation(VM_Builder &b, VM_Opcode opcode, Expression *e1,
+                            Symbol *op, Expression *e2) {
+  int32_t s1 = e1->vm_compile(b);
+  int32_t s2 = e2->vm_compile(b);
+  if (s1 == VM_NO_VALUE || s2 == VM_NO_VALUE || op_index(op) < 0) {
+    b.fail();
+    return VM_NO_VALUE;
+  }
+  int32_t result = b.result_register();
+  b.emit(opcode, {result, s1, s2, op_index(op)});
+  return result;
+}
+
+/*----------------------------------.
+|  vm_compile() implementation      |
+`----------------------------------*/
+
+int32_t Nil_Expr::vm_compile(VM_Builder &b) { return VM_NO_VALUE; }
+
+int32_t Single_Identifier::vm_compile(VM_Builder &b) {
+  return b.slot(this->name);
+}
+
+int32_t Owner_Identifier::vm_compile(VM_Builder &b) {
+  return b.slot(this->owner_name, this->name);
+}
+
+int32_t Nil_Identifier::vm_compile(VM_Builder &b) { return VM_NO_VALUE; }
+
+// Python keeps a variable initializing another as the value of the new
+// SaytringVar, not a copy of its value: the VM leaves that to python
+int32_t Var_Decl_Expr::vm_compile(VM_Builder &b) {
+  int32_t init = this->init->vm_compile(b);
+  if (init == VM_NO_VALUE || init >= 0) {
+    b.fail();
+    return VM_NO_VALUE;
+  }
+  b.emit(OP_DECL,
+         {b.slot(this->identifier), init, data_type(this->init->type)});
+  return VM_NO_VALUE;
+}
+
+int32_t Property_Decl_Expr::vm_compile(VM_Builder &b) {
+  // Assert this->identifier is a Single_Identifier
+  Single_Identifier *si = static_cast<Single_Identifier *>(this->owner_id);
+  b.emit(OP_CLEAR, {b.slot(si->name, this->property_name)});
+  return VM_NO_VALUE;
+}
+
+int32_t Assi_Expr::vm_compile(VM_Builder &b) {
+  int32_t id = this->id->vm_compile(b);
+  int32_t expr = this->expr->vm_compile(b);
+  if (id < 0 || expr == VM_NO_VALUE) {
+    b.fail();
+    return VM_NO_VALUE;
+  }
+  b.emit(OP_ASSIGN, {id, expr});
+  return VM_NO_VALUE;
+}
+
+// Mirrors Cast_Expr::code_generate()
+int32_t Cast_Expr::vm_compile(VM_Builder &b) {
+  if (to_type == NULL_Type || to_type == _list || id->type == to_type)
+    return VM_NO_VALUE;
+  auto it = type_cast_map->find(std::make_pair(id->type, to_type));
+  if (it == type_cast_map->end())
+    return VM_NO_VALUE; // Should never reach here
+
+  emit_builtin_call(b, find_builtin(it->second.c_str()),
+                    {id->vm_compile(b), return_id->vm_compile(b)});
+  return VM_NO_VALUE;
+}
+
+// The params in the order of generate_params(), which is the order Python
+// evaluates them in
+int32_t Direct_Call_Expr::vm_compile(VM_Builder &b) {
+  if (is_plain_say(this)) {
+    int32_t value = arg_list->at(0)->vm_compile(b);
+    b.emit(OP_PRINT, {value});
+    return VM_NO_VALUE;
+  }
+  std::vector<int32_t> operands;
+  if (!id->is_nil())
+    operands.push_back(id->vm_compile(b));
+  for (size_t i = arg_list->size(); i > 0; i--)
+    operands.push_back(arg_list->at(i - 1)->vm_compile(b));
+  if (!return_id->is_nil())
+    operands.push_back(return_id->vm_compile(b));
+  emit_builtin_call(b, find_builtin(func_name->get_string()), operands);
+  return VM_NO_VALUE;
+}
+
+// The steps one by one, which is what _str_chain() amounts to. A constant
+// source is stored in _anonymous for the first step to read.
+int32_t Chain_Call_Expr::vm_compile(VM_Builder &b) {
+  if (!dynamic_cast<Identifier *>(source)) {
+    int32_t value = source->vm_compile(b);
+    b.emit(OP_ASSIGN, {b.slot(_anonymous), value});
+  }
+  for (Expression *step : *steps)
+    step->vm_compile(b);
+  return VM_NO_VALUE;
+}
+
+int32_t Save_Expr::vm_compile(VM_Builder &b) {
+  b.emit(OP_SAVE, {saved->vm_compile(b), id->vm_compile(b)});
+  return VM_NO_VALUE;
+}
+
+// The variables the call reads decide whether the result in saved is
+// stored instead, see _reuse() of runtime.py
+int32_t Reused_Call_Expr::vm_compile(VM_Builder &b) {
+  std::vector<int32_t> inputs;
+  if (!call->id->is_nil())
+    inputs.push_back(call->id->vm_compile(b));
+  for (Expression *arg : *call->arg_list)
+    if (dynamic_cast<Identifier *>(arg))
+      inputs.push_back(arg->vm_compile(b));
+  size_t reuse = b.emit(OP_REUSE, {saved->vm_compile(b),
+                                   call->return_id->vm_compile(b), 0,
+                                   (int32_t)inputs.size()});
+  for (int32_t input : inputs)
+    b.append(input);
+  call->vm_compile(b);
+  b.patch_here(reuse + 3);
+  return VM_NO_VALUE;
+}
+
+int32_t Cond_Call_Expr::vm_compile(VM_Builder &b) {
+  std::cerr << "Here should not appear Cond_Call_Expr!" << std::endl;
+  b.fail();
+  return VM_NO_VALUE;
+}
+
+int32_t Cond_Expr::vm_compile(VM_Builder &b) {
+  int32_t predictor = this->predictor->vm_compile(b);
+  if (predictor == VM_NO_VALUE) {
+    b.fail();
+    return VM_NO_VALUE;
+  }
+  size_t jump_else = b.emit(OP_JUMP_UNLESS, {predictor, 0});
+  vm_branch(b, _then_list);
+  if (!this->has_else) {
+    b.patch_here(jump_else + 2);
+    return VM_NO_VALUE;
+  }
+  size_t jump_end = b.emit(OP_JUMP, {0});
+  b.patch_here(jump_else + 2);
+  vm_branch(b, _else_list);
+  b.patch_here(jump_end + 1);
+  return VM_NO_VALUE;
+}
+
+int32_t Comp_Expr::vm_compile(VM_Builder &b) {
+  return vm_operation(b, OP_COMP, e1, op, e2);
+}
+
+// The value of an int constant, false if Python's int holds it only
+static bool int_constant_value(Expression *expr, long long &value) {
+  Int_Const_Expr *c = dynamic_cast<Int_Const_Expr *>(expr);
+  if (!c)
+    return false;
+  errno = 0;
+  value = strtoll(c->token->get_string(), nullptr, 10);
+  return errno != ERANGE;
+}
+
+// Ints are 64 bits, as in the C++ target, where Python's have no bound: a
+// sum of two int constants beyond 64 bits is left to python
+int32_t Arith_Expr::vm_compile(VM_Builder &b) {
+  long long v1, v2, r;
+  if (int_constant_value(e1, v1) && int_constant_value(e2, v2) &&
+      ((strcmp(op->get_string(), "ADD") == 0 &&
+        __builtin_add_overflow(v1, v2, &r)) ||
+       (strcmp(op->get_string(), "SUB") == 0 &&
+        __builtin_sub_overflow(v1, v2, &r)))) {
+    b.fail();
+    return VM_NO_VALUE;
+  }
+  return vm_operation(b, OP_ARITH, e1, op, e2);
+}
+
+int32_t String_Const_Expr::vm_compile(VM_Builder &b) {
+  return b.string_constant(
+      python_string_value({token->get_string(), (size_t)token->get_len()}));
+}
+
+// A constant beyond 64 bits is left to python
+int32_t Int_Const_Expr::vm_compile(VM_Builder &b) {
+  long long value;
+  if (!int_constant_value(this, value)) {
+    b.fail();
+    return VM_NO_VALUE;
+  }
+  return b.int_constant(value);
+}
+
+int32_t Bool_Const_Expr::vm_compile(VM_Builder &b) {
+  return b.bool_constant(this->value);
+}
@@ -0,0 +1,377 @@
+/*
+  Saytring Compiler. A compiler translating Saytring to Python.
+  Copyright (C) 2024 Haoyuan Li
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "vm.h"
+// The port of runtime.py the C++ target uses. It is included here alone,
+// away from parser.tab.h, whose token macros would clash with its names.
+#include "../runtime/runtime.h"
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unistd.h>
+
+// The interpreter of the bytecode of vm.h. Every variable is a SaytringVar
+// of vars, every value register a Value of values, and each opcode jumps
+// straight to the next one's code (threaded dispatch), with GCC's labels
+// as values. Other compilers get a switch.
+
+static Value constant_value(const VM_Constant &c) {
+  switch (c.kind) {
+  case VM_Constant::INT:
+    return Value(c.i);
+  case VM_Constant::BOOL:
+    return Value(c.i != 0);
+  default:
+    return Value(c.s);
+  }
+}
+
+// Run code from start up to a HALT
+static void execute(const int32_t *code, int32_t start, SaytringVar *vars,
+                    Value *values) {
+  const int32_t *pc = code + start;
+
+#define VAR(n) vars[pc[n]]
+#define VALUE(n) values[~pc[n]]
+#define ARG(n) (pc[n] >= 0 ? Arg(VAR(n)) : Arg(VALUE(n)))
+
+#if defined(__GNUC__)
+  static void *const labels[] = {
+#define VM_CORE_LABEL(op, operands) &&L_##op,
+#define VM_BUILTIN_LABEL(op, name, params) &&L_##op,
+      VM_CORE_OPS(VM_CORE_LABEL) VM_BUILTINS(VM_BUILTIN_LABEL)
+#undef VM_CORE_LABEL
+#undef VM_BUILTIN_LABEL
+  };
+#define TARGET(op) L_##op:
+#define DISPATCH() goto *labels[*pc]
+  DISPATCH();
+#else
+#define TARGET(op) case OP_##op:
+#define DISPATCH() continue
+  for (;;)
+    switch (*pc) {
+#endif
+
+  TARGET(HALT) { return; }
+
+  TARGET(DECL) {
+    VAR(1) = SaytringVar(pc[2] >= 0 ? VAR(2).get_value() : VALUE(2),
+                         (DataType)pc[3]);
+    pc += 4;
+    DISPATCH();
+  }
+
+  TARGET(CLEAR) {
+    VAR(1) = SaytringVar();
+    pc += 2;
+    DISPATCH();
+  }
+
+  TARGET(ASSIGN) {
+    if (pc[2] >= 0)
+      VAR(1).set_value(VAR(2));
+    else
+      VAR(1).set_value(VALUE(2));
+    pc += 3;
+    DISPATCH();
+  }
+
+  TARGET(SAVE) {
+    VAR(1) = VAR(2);
+    pc += 3;
+    DISPATCH();
+  }
+
+  TARGET(COMP) {
+    VALUE(1) = comp(ARG(2), ARG(3), (Op)pc[4]);
+    pc += 5;
+    DISPATCH();
+  }
+
+  TARGET(ARITH) {
+    VALUE(1) = arithmetic(ARG(2), ARG(3), (Op)pc[4]);
+    pc += 5;
+    DISPATCH();
+  }
+
+  TARGET(JUMP) {
+    pc = code + pc[1];
+    DISPATCH();
+  }
+
+  TARGET(JUMP_UNLESS) {
+    pc = bool_wrap(ARG(1)) ? pc + 3 : code + pc[2];
+    DISPATCH();
+  }
+
+  TARGET(REUSE) {
+    int32_t n = pc[4];
+    bool reuse = true;
+    for (int32_t i = 0; i < n; i++)
+      if (VAR(5 + i).get_type() == DataType::NULL_TYPE)
+        reuse = false;
+    if (reuse) {
+      VAR(2) = VAR(1);
+      pc = code + pc[3];
+    } else {
+      pc += 5 + n;
+    }
+    DISPATCH();
+  }
+
+  TARGET(PRINT) {
+    print(VALUE(1));
+    pc += 2;
+    DISPATCH();
+  }
+
+  // A built-in takes its operands as its params
+#define CALL_V(f) f(VAR(1)), pc += 2
+#define CALL_A(f) f(ARG(1)), pc += 2
+#define CALL_VV(f) f(VAR(1), VAR(2)), pc += 3
+#define CALL_AV(f) f(ARG(1), VAR(2)), pc += 3
+#define CALL_VAV(f) f(VAR(1), ARG(2), VAR(3)), pc += 4
+#define CALL_VAAV(f) f(VAR(1), ARG(2), ARG(3), VAR(4)), pc += 5
+#define VM_BUILTIN_TARGET(op, name, params)                                    \
+  TARGET(op) {                                                                 \
+    CALL_##params(name);                                                       \
+    DISPATCH();                                                                \
+  }
+  VM_BUILTINS(VM_BUILTIN_TARGET)
+#undef VM_BUILTIN_TARGET
+
+#if !defined(__GNUC__)
+    default:
+      return;
+    }
+#endif
+#undef TARGET
+#undef DISPATCH
+#undef VAR
+#undef VALUE
+#undef ARG
+}
+
+// The records of record mode: the lines of a file, read in shards of whole
+// lines of about a block each
+class Record_Reader {
+  int fd;
+  std::vector<char> buffer;
+  size_t begin = 0, end = 0; // what is left of the last block read
+  bool eof = false;
+
+public:
+  explicit Record_Reader(int fd) : fd(fd), buffer(1 << 20) {}
+
+  // Read the next shard into shard, its line breaks kept. Return false at
+  // the end of the file.
+  bool next_shard(std::string &shard) {
+    shard.clear();
+    for (;;) {
+      const char *start = buffer.data() + begin;
+      const char *last = (const char *)memrchr(start, '\n', end - begin);
+      if (last) {
+        shard.append(start, last + 1 - start);
+        begin += last + 1 - start;
+        return true;
+      }
+      // No line ends in the rest of the block
+      shard.append(start, end - begin);
+      begin = end = 0;
+      if (eof)
+        return !shard.empty();
+      ssize_t n = read(fd, buffer.data(), buffer.size());
+      if (n < 0) {
+        if (errno == EINTR)
+          continue;
+        throw Fatal_Error{std::string("OSError: ") + strerror(errno)};
+      }
+      if (n == 0)
+        eof = true;
+      end = n;
+    }
+  }
+};
+
+// Run body once per line of shard. A line ends at '\n', "\r\n" or a lone
+// '\r', as with the universal newlines of fileinput, and the line break is
+// not part of the record; the last one may end at the end of the file
+// instead. Shards end at a '\n', so no "\r\n" is split between two.
+static void run_records(const std::string &shard, const int32_t *code,
+                        const VM_Layout &layout, SaytringVar *vars,
+                        Value *values) {
+  const char *p = shard.data(), *end = p + shard.size();
+  SaytringVar &record = vars[layout.record_slot];
+  while (p < end) {
+    const char *stop = (const char *)memchr(p, '\n', end - p);
+    if (!stop)
+      stop = end;
+    const char *next = stop < end ? stop + 1 : end;
+    const char *cr = (const char *)memchr(p, '\r', stop - p);
+    if (cr) {
+      // "\r\n" ends the line as one break
+      next = cr + 1 == stop ? next : cr + 1;
+      stop = cr;
+    }
+    record = SaytringVar(Value(std::string(p, stop - p)), DataType::STRING);
+    execute(code, layout.body, vars, values);
+    p = next;
+  }
+}
+
+// A shard of independent records, run by one of the threads of
+// run_shards()
+struct Record_Shard {
+  std::string text;
+  std::string output; // what its records printed
+  bool done = false;
+  bool failed = false;
+  std::string error; // the Fatal_Error it failed with
+};
+
+// Run the shards of reader on jobs threads, each on its own copy of the
+// variables and registers as the setup left them, and write what they
+// print in the order of the records. A few shards are read ahead of the
+// threads, so that the input is never all in memory. Throw the Fatal_Error
+// of the first record failing, after the output of the records before it.
+static void run_shards(Record_Reader &reader, unsigned jobs,
+                       const int32_t *code, const VM_Layout &layout,
+                       const std::vector<SaytringVar> &vars,
+                       const std::vector<Value> &values) {
+  std::mutex lock; // guards all below, and done of the shards
+  std::condition_variable work, done;
+  std::deque<std::unique_ptr<Record_Shard>> window; // read, not written
+  std::deque<Record_Shard *> queue;                 // read, not taken
+  bool closing = false;
+
+  auto worker = [&]() {
+    std::vector<SaytringVar> own_vars(vars);
+    std::vector<Value> own_values(values);
+    for (;;) {
+      Record_Shard *shard;
+      {
+        std::unique_lock<std::mutex> guard(lock);
+        work.wait(guard, [&] { return closing || !queue.empty(); });
+        if (queue.empty())
+          return;
+        shard = queue.front();
+        queue.pop_front();
+      }
+      print_buffer = &shard->output;
+      try {
+        run_records(shard->text, code, layout, own_vars.data(),
+                    own_values.data());
+      } catch (Fatal_Error &e) {
+        shard->failed = true;
+        shard->error = e.message;
+      }
+      print_buffer = nullptr;
+      std::string().swap(shard->text);
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        shard->done = true;
+      }
+      done.notify_all();
+    }
+  };
+  std::vector<std::thread> threads;
+  for (unsigned i = 0; i < jobs; i++)
+    threads.emplace_back(worker);
+
+  bool eof = false;
+  // The first record failing, and a failure to read the input, reported
+  // after the output of what was read before it
+  std::unique_ptr<Fatal_Error> error, read_error;
+  while (!error) {
+    while (!eof && window.size() < 2 * jobs) {
+      std::unique_ptr<Record_Shard> shard(new Record_Shard);
+      try {
+        eof = !reader.next_shard(shard->text);
+      } catch (Fatal_Error &e) {
+        read_error.reset(new Fatal_Error(e));
+        eof = true;
+      }
+      if (eof)
+        break;
+      std::lock_guard<std::mutex> guard(lock);
+      queue.push_back(shard.get());
+      window.push_back(std::move(shard));
+      work.notify_one();
+    }
+    if (window.empty())
+      break;
+    Record_Shard *front = window.front().get();
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      done.wait(guard, [&] { return front->done; });
+    }
+    fwrite(front->output.data(), 1, front->output.size(), stdout);
+    if (front->failed)
+      error.reset(new Fatal_Error{front->error});
+    window.pop_front();
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    closing = true;
+    queue.clear();
+  }
+  work.notify_all();
+  for (std::thread &t : threads)
+    t.join();
+  if (error)
+    throw *error;
+  if (read_error)
+    throw *read_error;
+}
+
+int vm_run(const int32_t *code, const VM_Layout &layout,
+           const std::vector<VM_Constant> &constants, int records,
+           unsigned jobs) {
+  std::vector<SaytringVar> vars(layout.slot_count);
+  std::vector<Value> values(layout.register_count);
+  for (const VM_Constant &c : constants)
+    values[c.reg] = constant_value(c);
+  try {
+    execute(code, 0, vars.data(), values.data());
+    if (layout.record_slot >= 0) {
+      Record_Reader reader(records);
+      if (jobs == 0)
+        jobs = std::max(1u, std::thread::hardware_concurrency());
+      if (layout.independent && jobs > 1) {
+        run_shards(reader, jobs, code, layout, vars, values);
+      } else {
+        std::string shard;
+        while (reader.next_shard(shard))
+          run_records(shard, code, layout, vars.data(), values.data());
+      }
+    }
+  } catch (Fatal_Error &e) {
+    fflush(stdout);
+    fprintf(stderr, "Traceback (most recent call last):\n%s\n",
+            e.message.c_str());
+    return 1;
+  }
+  fflush(stdout);
+  return 0;
+}
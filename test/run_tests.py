@@ -0,0 +1,578 @@
+#!/usr/bin/env python3
+#  Saytring Compiler. A compiler translating Saytring to Python.
+#  Copyright (C) 2024 Haoyuan Li
+#
+#  This program is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 3 of the License, or
+#  (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+"""Compile and run the fixtures of this directory, and check what they print.
+
+    run_tests.py --compiler ../src/saytringc --runtime ../runtime/runtime.py \
+                 --cpp-runtime ../runtime/runtime.h
+
+A fixture is a <name>.say with a <name>.expected next to it, holding what
+the program prints on stdout, the runtime's warnings included. If there is
+a <name>.in, the program reads it on stdin. If there is a <name>.records,
+the program is compiled with --records and runs once per line of it. The
+samples without an .expected are only examples.
+
+Lines of the fixture starting with "# test:" ask for more checks:
+
+    # test: vm    also precompile the program and run it with --exec, on
+                  the VM, which must print the same
+    # test: cpp   also compile it with --target cpp, whose binary must print
+                  the same
+    # test: python
+                  the VM cannot run it as python does, so --precompile
+                  must refuse it
+    # test: run   also compile it with --run, which must print the same
+                  after its banner
+    # test: jobs N...
+                  run it with --exec, and --run, with each of these --jobs
+    # test: independent, or dependent
+                  what --debug must say of its records
+    # test: lines N
+                  also run it on N records "<i> <line>", i counting from 1
+                  and line cycling through the .records, so that a large N
+                  spans several shards of the VM. The VM, and --run, must
+                  print what python prints, and fail if python does.
+    # test: fails
+                  python must fail on those N records
+
+Then the modes compiling many programs in one process are checked, each
+under its own name, which may be given as well:
+
+    batch         --batch over this directory writes what compiling each
+                  .say alone writes, and fails for those that fail alone.
+                  A batch of two inputs with the same output is refused.
+    serve         requests to --serve get what compiling alone writes, on
+                  one connection and on several at once, and a source
+                  above the limit or a broken header closes the connection
+    cache         a program compiled again with --cache is found there and
+                  reported as before, warnings included, and is not found
+                  once its source, the runtime or the flags change
+"""
+
+import argparse
+import os
+import socket
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+
+def fixtures(names):
+    for entry in sorted(os.listdir(HERE)):
+        name, ext = os.path.splitext(entry)
+        if ext != ".say" or names and name not in names:
+            continue
+        if os.path.exists(os.path.join(HERE, name + ".expected")):
+            yield name
+
+
+def read(path, default=None):
+    if not os.path.exists(path):
+        return default
+    with open(path, "rb") as f:
+        return f.read()
+
+
+# The directives, by the number of words they take
+DIRECTIVES = {"vm": 0, "cpp": 0, "python": 0, "run": 0, "jobs": None, "independent": 0, "dependent": 0,
+              "lines": 1, "fails": 0}
+
+
+def directives(source):
+    """The directives of source, each "# test:" line by its first word."""
+    found = {}
+    for line in source.decode().splitlines():
+        if line.startswith("# test:"):
+            words = line[len("# test:"):].split()
+            if not words or words[0] not in DIRECTIVES or \
+                    DIRECTIVES[words[0]] not in (None, len(words) - 1):
+                raise ValueError("bad directive: " + line)
+            found[words[0]] = words[1:]
+    return found
+
+
+def numbered(records, count, path):
+    """Write count numbered records cycling through the file records."""
+    lines = read(records).decode().splitlines()
+    with open(path, "w") as f:
+        for i in range(count):
+            f.write("%d %s\n" % (i + 1, lines[i % len(lines)]))
+
+
+def run(command, stdin, expected, what):
+    """Run command, return the list of its failures to print expected."""
+    proc = subprocess.run(command, input=stdin, capture_output=True)
+    if proc.returncode != 0:
+        return ["%s exits with %d:\n%s" % (what, proc.returncode,
+                                           proc.stderr.decode())]
+    if proc.stdout != expected:
+        return ["%s prints:\n%s" % (what,
+                                    proc.stdout.decode(errors="replace"))]
+    return []
+
+
+def run_by_compiler(command, jobs, records, stdin, expected, status):
+    """Compile with --run, return the list of its failures to print expected
+    after the banner. If status is not 0, the program must fail after
+    printing expected, as python did."""
+    what = " ".join(["--run"] + jobs)
+    proc = subprocess.run(command + ["--run"] + jobs +
+                          (["--records", records] if records else []),
+                          input=stdin, capture_output=True)
+    banner, _, printed = proc.stdout.partition(b"--------\n")
+    if proc.returncode != 0 or b"Saytring v" not in banner:
+        return ["%s exits with %d:\n%s" %
+                (what, proc.returncode, (proc.stdout + proc.stderr).decode())]
+    if status == 0 and printed != expected or status != 0 and \
+            not printed.startswith(expected + b"Error: "):
+        return ["%s prints:\n%s" % (what,
+                                    printed.decode(errors="replace")[-2000:])]
+    return []
+
+
+def check(args, name, workdir):
+    """Return the list of failures of fixture name."""
+    source = os.path.join(HERE, name + ".say")
+    expected = read(os.path.join(HERE, name + ".expected"))
+    stdin = read(os.path.join(HERE, name + ".in"), b"")
+    records = os.path.join(HERE, name + ".records")
+    if not os.path.exists(records):
+        records = None
+    try:
+        tests = directives(read(source))
+    except ValueError as e:
+        return [str(e)]
+    output = os.path.join(workdir, name + ".py")
+    image = os.path.join(workdir, name + ".sayc")
+
+    command = [args.compiler, "-i", source, "-o", output, "-t", args.runtime]
+    if records:
+        command += ["--records", "-"]
+    if "vm" in tests:
+        command += ["--precompile", image, "--debug"]
+    proc = subprocess.run(command, capture_output=True)
+    if proc.returncode != 0 or not os.path.exists(output):
+        return ["does not compile:\n" + proc.stdout.decode() +
+                proc.stderr.decode()]
+    failures = []
+    for kind in ("independent", "dependent"):
+        if kind in tests and b"Records are %s\n" % kind.encode() \
+                not in proc.stdout:
+            failures.append("its records are not found " + kind)
+
+    failures += run([args.python, output] + ([records] if records else []),
+                    stdin, expected, "python")
+    if "cpp" in tests:
+        native = os.path.join(workdir, name)
+        proc = subprocess.run([args.compiler, "-i", source, "-o",
+                               native + ".cc", "-t", args.cpp_runtime,
+                               "--target", "cpp"], capture_output=True)
+        if proc.returncode != 0 or not os.path.exists(native):
+            failures.append("does not compile to C++:\n" +
+                            proc.stdout.decode() + proc.stderr.decode())
+        else:
+            failures += run([native], stdin, expected, "C++")
+    if "python" in tests:
+        proc = subprocess.run(command[:7] + ["--precompile", image] +
+                              (["--records", "-"] if records else []),
+                              capture_output=True)
+        if proc.returncode == 0 or os.path.exists(image):
+            failures.append("--precompile does not refuse it")
+    jobs = [["-j", n] for n in tests.get("jobs", [])] or [[]]
+    for j in jobs:
+        if "run" in tests:
+            failures += run_by_compiler(command[:7], j, records, stdin,
+                                        expected, 0)
+        if "vm" in tests:
+            failures += run([args.compiler, "--exec", image] + j +
+                            (["--records", records] if records else []),
+                            stdin, expected, " ".join(["the VM"] + j))
+
+    if "lines" not in tests:
+        return failures
+    lines = os.path.join(workdir, name + ".lines")
+    numbered(records, int(tests["lines"][0]), lines)
+    python = subprocess.run([args.python, output, lines], input=stdin,
+                            capture_output=True)
+    if (python.returncode != 0) != ("fails" in tests):
+        failures.append("python exits with %d on %s lines:\n%s" %
+                        (python.returncode, tests["lines"][0],
+                         python.stderr.decode()[-2000:]))
+    for j in jobs:
+        if "run" in tests:
+            failures += run_by_compiler(command[:7], j, lines, stdin,
+                                        python.stdout, python.returncode)
+        if "vm" not in tests:
+            continue
+        vm = subprocess.run([args.compiler, "--exec", image] + j +
+                            ["--records", lines],
+                            input=stdin, capture_output=True)
+        what = " ".join(["the VM"] + j)
+        if (vm.returncode != 0) != (python.returncode != 0):
+            failures.append("%s exits with %d on %s lines, python with "
+                            "%d" % (what, vm.returncode, tests["lines"][0],
+                                    python.returncode))
+        if vm.stdout != python.stdout:
+            failures.append("%s prints otherwise than python on %s "
+                            "lines" % (what, tests["lines"][0]))
+    return failures
+
+
+def compile_alone(args, workdir):
+    """Compile each .say of this directory alone, once, and return the .say
+    by what they compile to, None for those failing to compile."""
+    single = os.path.join(workdir, "single")
+    inputs = sorted(entry for entry in os.listdir(HERE)
+                    if entry.endswith(".say"))
+    if not os.path.exists(single):
+        os.makedirs(single)
+        for entry in inputs:
+            subprocess.run([args.compiler, "-i", os.path.join(HERE, entry),
+                            "-o", os.path.join(single, entry[:-4] + ".py"),
+                            "-t", args.runtime], capture_output=True)
+    return {entry: read(os.path.join(single, entry[:-4] + ".py"))
+            for entry in inputs}
+
+
+def check_batch(args, workdir):
+    """Return the list of failures of --batch over this directory."""
+    failures = []
+    alone = compile_alone(args, workdir)
+    inputs = sorted(alone)
+    failed = sum(code is None for code in alone.values())
+
+    logs = []
+    for jobs in ("1", "4"):
+        batch = os.path.join(workdir, "batch" + jobs)
+        proc = subprocess.run([args.compiler, "--batch", HERE, "-o", batch,
+                               "-t", args.runtime, "-j", jobs],
+                              capture_output=True)
+        what = "--batch -j " + jobs
+        if (proc.returncode != 0) != (failed > 0) or \
+                b"Compiled %d files (%d failed)" % (len(inputs), failed) \
+                not in proc.stdout:
+            failures.append("%s exits with %d:\n%s" %
+                            (what, proc.returncode,
+                             proc.stdout.decode()[-2000:]))
+        for entry in inputs:
+            if read(os.path.join(batch, entry[:-4] + ".py")) != alone[entry]:
+                failures.append("%s writes otherwise than compiling %s "
+                                "alone" % (what, entry))
+        # The logs come in the order of the inputs, whatever the threads
+        logs.append(proc.stdout.rpartition(b"\nCompiled ")[0]
+                    .replace(batch.encode(), b"<output>"))
+    if logs[0] != logs[1]:
+        failures.append("--batch -j 4 logs otherwise than -j 1")
+
+    # The same name from two directories, and the same input twice
+    other = os.path.join(workdir, "other")
+    os.makedirs(other, exist_ok=True)
+    with open(os.path.join(other, "fold.say"), "wb") as f:
+        f.write(read(os.path.join(HERE, "fold.say")))
+    for inputs in ([os.path.join(HERE, "fold.say"),
+                    os.path.join(other, "fold.say")],
+                   [os.path.join(HERE, "fold.say")] * 2):
+        listing = os.path.join(workdir, "inputs")
+        with open(listing, "w") as f:
+            f.write("".join(path + "\n" for path in inputs))
+        batch = os.path.join(workdir, "duplicate")
+        proc = subprocess.run([args.compiler, "--batch", listing, "-o", batch,
+                               "-t", args.runtime], capture_output=True)
+        if proc.returncode == 0 or b"would both be compiled to" \
+                not in proc.stderr or os.path.exists(batch):
+            failures.append("--batch does not refuse to compile %s and %s "
+                            "to one output" % tuple(inputs))
+    return failures
+
+
+# The largest source a request to --serve may send, SERVER_MAX_SOURCE
+SERVER_MAX_SOURCE = 64 << 20
+
+
+def recv_exactly(sock, size):
+    data = b""
+    while len(data) < size:
+        chunk = sock.recv(min(size - len(data), 1 << 16))
+        if not chunk:
+            break
+        data += chunk
+    return data
+
+
+def request(sock, name, source):
+    """Send one compile request, in pieces as a slow client might, and
+    return its status, diagnostics and code."""
+    header = b"%s %d\n" % (name.encode(), len(source))
+    for piece in (header[:3], header[3:], source[:len(source) // 2],
+                  source[len(source) // 2:]):
+        sock.sendall(piece)
+    return response(sock)
+
+
+def response(sock):
+    """Read the response to a request: its status, diagnostics and code."""
+    reply = b""
+    while not reply.endswith(b"\n"):
+        byte = sock.recv(1)
+        if not byte:
+            return None, b"", b""
+        reply += byte
+    status, diag_length, code_length = reply.split()
+    diagnostics = recv_exactly(sock, int(diag_length))
+    return status.decode(), diagnostics, recv_exactly(sock, int(code_length))
+
+
+def closed(sock):
+    """Whether the server has closed the connection."""
+    try:
+        return sock.recv(1) == b""
+    except OSError:
+        return False
+
+
+def rss(pid):
+    """The resident set size of process pid, in kB."""
+    with open("/proc/%d/status" % pid) as f:
+        for line in f:
+            if line.startswith("VmRSS:"):
+                return int(line.split()[1])
+    return 0
+
+
+def check_serve(args, workdir):
+    """Return the list of failures of requests to --serve."""
+    failures = []
+    alone = compile_alone(args, workdir)
+    path = os.path.join(workdir, "serve.sock")
+    server = subprocess.Popen([args.compiler, "--serve", path, "-t",
+                               args.runtime], stdout=subprocess.PIPE,
+                              stderr=subprocess.PIPE)
+    try:
+        if not server.stdout.readline().startswith(b"Serving on "):
+            return ["--serve does not start:\n" +
+                    server.stderr.read().decode()]
+        serve_requests(path, server.pid, alone, failures)
+    except OSError as e:
+        failures.append("a request to --serve fails: %s" % e)
+    finally:
+        server.kill()
+        server.wait()
+    return failures
+
+
+def serve_requests(path, pid, alone, failures):
+    """Add to failures those of requests to the server of process pid,
+    listening at path."""
+
+    def connect():
+        sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        # A server out of step with its client must not hang the tests
+        sock.settimeout(60)
+        sock.connect(path)
+        return sock
+
+    # Every input on one connection, then on one connection each at once
+    def compile_all(sock, entries, what):
+        for entry in entries:
+            source = read(os.path.join(HERE, entry))
+            status, diagnostics, code = request(sock, entry, source)
+            if status != ("error" if alone[entry] is None else "ok") or \
+                    code != (alone[entry] or b""):
+                failures.append("%s of %s gets %s:\n%s" %
+                                (what, entry, status, diagnostics.decode()))
+
+    with connect() as sock:
+        compile_all(sock, sorted(alone), "a request")
+    sockets = [connect() for _ in alone]
+    threads = [threading.Thread(target=compile_all,
+                                args=(sock, [entry], "a parallel request"))
+               for sock, entry in zip(sockets, sorted(alone))]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+    for sock in sockets:
+        sock.close()
+
+    # Each request has a symbol table of its own, freed with it: a name
+    # declared by a request is unknown to the next one, and requests of
+    # fresh names do not make the server grow
+    with connect() as sock:
+        declared, _, _ = request(sock, "declares",
+                                 b'define secret as ("x")\n')
+        status, diagnostics, _ = request(sock, "uses", b"say(secret)\n")
+        if declared != "ok" or status != "error" or \
+                b"Undefined identifier" not in diagnostics:
+            failures.append("a request sees the names of the one before")
+        sizes = []
+        for i in range(400):
+            source = b"".join(b"define name_%d_%d as (%d)\n" % (i, j, j)
+                              for j in range(2000))
+            status, diagnostics, _ = request(sock, "names", source)
+            if status != "ok":
+                failures.append("a request of fresh names gets %s:\n%s" %
+                                (status, diagnostics.decode()))
+                break
+            if i in (99, 399):
+                sizes.append(rss(pid))
+        # 300 requests of 2000 names leaked would be more than 30 MB
+        if len(sizes) == 2 and sizes[1] - sizes[0] > 16 << 10:
+            failures.append("--serve grows from %d kB to %d kB over 300 "
+                            "requests of fresh names" % tuple(sizes))
+
+    # A request of SERVER_MAX_SOURCE bytes is served, one more is refused
+    # before its source is sent, and the connection is closed
+    with connect() as sock:
+        statement = b'say("largest")\n'
+        status, _, _ = request(sock, "largest", statement + b"\n" *
+                               (SERVER_MAX_SOURCE - len(statement)))
+        if status != "ok":
+            failures.append("a request of %d bytes gets %s" %
+                            (SERVER_MAX_SOURCE, status))
+        sock.sendall(b"larger %d\n" % (SERVER_MAX_SOURCE + 1))
+        status, diagnostics, _ = response(sock)
+        if status != "error" or b"larger than" not in diagnostics or \
+                not closed(sock):
+            failures.append("a request of %d bytes gets %s:\n%s" %
+                            (SERVER_MAX_SOURCE + 1, status,
+                             diagnostics.decode()))
+    for header in (b"nonsense\n", b"negative -1\n", b"\n"):
+        with connect() as sock:
+            sock.sendall(header)
+            status, diagnostics, code = response(sock)
+            if (status, diagnostics, code) != ("error", b"", b"") or \
+                    not closed(sock):
+                failures.append("the header %r gets %s" % (header, status))
+
+
+def check_cache(args, workdir):
+    """Return the list of failures of compiling with --cache."""
+    failures = []
+    cache = os.path.join(workdir, "cache")
+    source = os.path.join(HERE, "sample_warn.say")
+
+    def compile_cached(command, output, what, hits, expected):
+        """Compile to output with the cache, which must be hit hits times,
+        and return the log, but for the timings and the cache report."""
+        if os.path.exists(output):
+            os.remove(output)
+        proc = subprocess.run(command + ["-c", cache, "--debug"],
+                              stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+        if proc.returncode != 0 or \
+                b"Cache %s: %d hits" % (cache.encode(), hits) \
+                not in proc.stdout:
+            failures.append("%s is not found %d times in the cache:\n%s" %
+                            (what, hits, proc.stdout.decode()))
+        if read(output) != expected:
+            failures.append("%s from the cache is not what it compiles "
+                            "to" % what)
+        return [line for line in proc.stdout.splitlines()
+                if not line.startswith((b"Cache ", b"Compilation completed",
+                                        b"Compiled "))]
+
+    def uncached(command, output):
+        subprocess.run(command, capture_output=True)
+        return read(output)
+
+    # Found the second time, and reported with the same warnings
+    output = os.path.join(workdir, "cached.py")
+    single = [args.compiler, "-i", source, "-o", output, "-t", args.runtime]
+    expected = uncached(single, output)
+    log = compile_cached(single, output, "sample_warn.say", 0, expected)
+    if compile_cached(single, output, "sample_warn.say again", 1,
+                      expected) != log:
+        failures.append("sample_warn.say from the cache is reported "
+                        "otherwise")
+    if not any(b"Warning" in line for line in log):
+        failures.append("sample_warn.say warns of nothing")
+
+    # Not found once anything the output depends on changes: the source,
+    # the runtime or the flags in the salt
+    edited = os.path.join(workdir, "edited.say")
+    with open(edited, "wb") as f:
+        f.write(read(source) + b'say("edited")\n')
+    runtime = os.path.join(workdir, "runtime.py")
+    with open(runtime, "wb") as f:
+        f.write(read(args.runtime) + b"\n# edited\n")
+    listing = os.path.join(workdir, "cached.list")
+    with open(listing, "w") as f:
+        f.write(source + "\n")
+    batch_dir = os.path.join(workdir, "cached")
+    batch = [args.compiler, "--batch", listing, "-o", batch_dir, "-t",
+             args.runtime]
+    batch_output = os.path.join(batch_dir, "sample_warn.py")
+    for command, out, what in (
+            ([args.compiler, "-i", edited, "-o", output, "-t", args.runtime],
+             output, "its edit"),
+            (single[:-1] + [runtime], output, "it with another runtime"),
+            (single + ["--full-runtime"], output, "it with --full-runtime"),
+            (single + ["--records", "-"], output, "it with --records")):
+        compile_cached(command, out, what, 0, uncached(command, out))
+
+    # A batch is found the second time, by batches only
+    expected = uncached(batch, batch_output)
+    log = compile_cached(batch, batch_output, "a batch of it", 0, expected)
+    if compile_cached(batch, batch_output, "a batch of it again", 1,
+                      expected) != log:
+        failures.append("a batch from the cache is reported otherwise")
+    return failures
+
+
+# The modes, run after the fixtures
+MODES = {"batch": check_batch, "serve": check_serve, "cache": check_cache}
+
+
+def report(name, failures):
+    """Print the failures of name, return whether there are any."""
+    print("%-24s %s" % (name, "FAIL" if failures else "ok"))
+    for failure in failures:
+        print("  " + failure.replace("\n", "\n  ").rstrip())
+    return bool(failures)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--compiler",
+                        default=os.path.join(HERE, "..", "src", "saytringc"))
+    parser.add_argument("--runtime",
+                        default=os.path.join(HERE, "..", "runtime",
+                                             "runtime.py"))
+    parser.add_argument("--cpp-runtime",
+                        default=os.path.join(HERE, "..", "runtime",
+                                             "runtime.h"))
+    parser.add_argument("--python", default="python3")
+    parser.add_argument("names", nargs="*",
+                        help="fixtures and modes to run, all if none")
+    args = parser.parse_args()
+
+    failed = 0
+    with tempfile.TemporaryDirectory() as workdir:
+        for name in fixtures(args.names):
+            failed += report(name, check(args, name, workdir))
+        for name, check_mode in MODES.items():
+            if not args.names or name in args.names:
+                failed += report(name, check_mode(args, workdir))
+    if failed:
+        print("%d checks failed" % failed)
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())